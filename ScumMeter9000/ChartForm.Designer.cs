@@ -33,7 +33,6 @@ private void InitializeComponent()
             this.toolStripStatusLabel1 = new System.Windows.Forms.ToolStripStatusLabel();
             this.btnDownloadData = new System.Windows.Forms.Button();
             this.chart1 = new System.Windows.Forms.DataVisualization.Charting.Chart();
-            this.batteryMeasurementModelBindingSource = new System.Windows.Forms.BindingSource(this.components);
             this.dataGridView1 = new System.Windows.Forms.DataGridView();
             this.Column1 = new System.Windows.Forms.DataGridViewTextBoxColumn();
             this.Column2 = new System.Windows.Forms.DataGridViewTextBoxColumn();
@@ -43,9 +42,10 @@ private void InitializeComponent()
             this.scumControllerBindingSource = new System.Windows.Forms.BindingSource(this.components);
             this.loggingView1 = new Tools.LoggingView();
             this.button1 = new System.Windows.Forms.Button();
+            this.btnDownloadAlarms = new System.Windows.Forms.Button();
+            this.chkLive = new System.Windows.Forms.CheckBox();
             this.statusStrip1.SuspendLayout();
             ((System.ComponentModel.ISupportInitialize)(this.chart1)).BeginInit();
-            ((System.ComponentModel.ISupportInitialize)(this.batteryMeasurementModelBindingSource)).BeginInit();
             ((System.ComponentModel.ISupportInitialize)(this.dataGridView1)).BeginInit();
             ((System.ComponentModel.ISupportInitialize)(this.scumControllerBindingSource)).BeginInit();
             this.SuspendLayout();
@@ -119,7 +119,6 @@ private void InitializeComponent()
             chartArea1.AxisY2.Minimum = 0D;
             chartArea1.Name = "ChartArea1";
             this.chart1.ChartAreas.Add(chartArea1);
-            this.chart1.DataSource = this.batteryMeasurementModelBindingSource;
             legend1.Name = "Legend1";
             this.chart1.Legends.Add(legend1);
             this.chart1.Location = new System.Drawing.Point(12, -7);
@@ -157,11 +156,6 @@ private void InitializeComponent()
             title1.Text = "Battery Meter";
             this.chart1.Titles.Add(title1);
             // 
-            // batteryMeasurementModelBindingSource
-            // 
-            this.batteryMeasurementModelBindingSource.DataMember = "BatteryMeasurementModel";
-            this.batteryMeasurementModelBindingSource.DataSource = this.scumControllerBindingSource;
-            // 
             // dataGridView1
             // 
             this.dataGridView1.AllowUserToAddRows = false;
@@ -174,7 +168,6 @@ private void InitializeComponent()
             this.Column2,
             this.voltsDataGridViewTextBoxColumn,
             this.ampsDataGridViewTextBoxColumn});
-            this.dataGridView1.DataSource = this.batteryMeasurementModelBindingSource;
             this.dataGridView1.Location = new System.Drawing.Point(12, 347);
             this.dataGridView1.Name = "dataGridView1";
             this.dataGridView1.ReadOnly = true;
@@ -256,11 +249,35 @@ private void InitializeComponent()
             this.button1.UseVisualStyleBackColor = true;
             this.button1.Click += new System.EventHandler(this.button1_Click);
             // 
+            // btnDownloadAlarms
+            // 
+            this.btnDownloadAlarms.Location = new System.Drawing.Point(566, 677);
+            this.btnDownloadAlarms.Name = "btnDownloadAlarms";
+            this.btnDownloadAlarms.Size = new System.Drawing.Size(98, 35);
+            this.btnDownloadAlarms.TabIndex = 18;
+            this.btnDownloadAlarms.Text = "Download Alarms";
+            this.btnDownloadAlarms.UseVisualStyleBackColor = true;
+            this.btnDownloadAlarms.Click += new System.EventHandler(this.btnDownloadAlarms_Click);
+            // 
+            // chkLive
+            // 
+            this.chkLive.Appearance = System.Windows.Forms.Appearance.Button;
+            this.chkLive.Location = new System.Drawing.Point(682, 677);
+            this.chkLive.Name = "chkLive";
+            this.chkLive.Size = new System.Drawing.Size(98, 35);
+            this.chkLive.TabIndex = 19;
+            this.chkLive.Text = "Live";
+            this.chkLive.TextAlign = System.Drawing.ContentAlignment.MiddleCenter;
+            this.chkLive.UseVisualStyleBackColor = true;
+            this.chkLive.CheckedChanged += new System.EventHandler(this.chkLive_CheckedChanged);
+            // 
             // ChartForm
             // 
             this.AutoScaleDimensions = new System.Drawing.SizeF(6F, 13F);
             this.AutoScaleMode = System.Windows.Forms.AutoScaleMode.Font;
             this.ClientSize = new System.Drawing.Size(929, 832);
+            this.Controls.Add(this.chkLive);
+            this.Controls.Add(this.btnDownloadAlarms);
             this.Controls.Add(this.button1);
             this.Controls.Add(this.btnSave);
             this.Controls.Add(this.dataGridView1);
@@ -282,7 +299,6 @@ private void InitializeComponent()
             this.statusStrip1.ResumeLayout(false);
             this.statusStrip1.PerformLayout();
             ((System.ComponentModel.ISupportInitialize)(this.chart1)).EndInit();
-            ((System.ComponentModel.ISupportInitialize)(this.batteryMeasurementModelBindingSource)).EndInit();
             ((System.ComponentModel.ISupportInitialize)(this.dataGridView1)).EndInit();
             ((System.ComponentModel.ISupportInitialize)(this.scumControllerBindingSource)).EndInit();
             this.ResumeLayout(false);
@@ -301,7 +317,6 @@ private void InitializeComponent()
         private System.Windows.Forms.Button btnDownloadData;
         private System.Windows.Forms.DataVisualization.Charting.Chart chart1;
         private System.Windows.Forms.BindingSource scumControllerBindingSource;
-        private System.Windows.Forms.BindingSource batteryMeasurementModelBindingSource;
         private System.Windows.Forms.DataGridView dataGridView1;
         private System.Windows.Forms.DataGridViewTextBoxColumn Column1;
         private System.Windows.Forms.DataGridViewTextBoxColumn Column2;
@@ -309,6 +324,8 @@ private void InitializeComponent()
         private System.Windows.Forms.DataGridViewTextBoxColumn ampsDataGridViewTextBoxColumn;
         private System.Windows.Forms.Button btnSave;
         private System.Windows.Forms.Button button1;
+        private System.Windows.Forms.Button btnDownloadAlarms;
+        private System.Windows.Forms.CheckBox chkLive;
     }
 }
 
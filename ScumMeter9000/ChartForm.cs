@@ -1,9 +1,11 @@
 ﻿using System;
+using System.Collections.Generic;
 using System.Drawing;
 using System.Windows.Forms;
 using System.Globalization;
 using CommandMessenger;
 using System.IO;
+using System.Threading.Tasks;
 
 namespace DataLogging
 {
@@ -15,12 +17,21 @@ public partial class ChartForm : Form
         private readonly ScumController _scumControl;
         private bool _connected;
 
+        // Decimated points for the chart. Reused to save reallocating them on every render.
+        private readonly List<double> _voltsX = new List<double>();
+        private readonly List<double> _volts = new List<double>();
+        private readonly List<double> _ampsX = new List<double>();
+        private readonly List<double> _amps = new List<double>();
+
         public ChartForm()
         {
             InitializeComponent();
             _scumControl = new ScumController();
-            batteryMeasurementModelBindingSource.DataSource = _scumControl.BatteryMeasurementModel;
             chart1.Palette = System.Windows.Forms.DataVisualization.Charting.ChartColorPalette.Excel;
+            chart1.AxisViewChanged += (sender, e) => RenderChart();
+            // Rows are fetched from the measurement store as they are shown
+            dataGridView1.VirtualMode = true;
+            dataGridView1.CellValueNeeded += DataGridViewCellValueNeeded;
             DisplayEmptyChart();
         }
 
@@ -53,21 +64,71 @@ public void BeginDataDownload()
         public void EndDataDownload()
         {
        //     lstDataDisplay.EndUpdate();
-            if (_scumControl._batteryMeasurementModel.Count > 0)
+            RenderChart();
+        }
+
+        // Live items are plotted as they arrive. Downloaded ones are plotted at the end.
+        public void UpdateDataItem(DateTime dt, double volts, double amps, bool live = false)
+        {
+//            lstDataDisplay.Items.Add(new ListViewItem(new [] {dt.ToShortDateString(), dt.ToShortTimeString(), volts.ToString(), amps.ToString()}));
+            if (live)
             {
-                DisplayEmptyChart();
+                RenderChart();
             }
-            else
+        }
+
+        // Plot the visible part of the measurement store, reduced to the
+        // minimum and maximum for each pixel column.
+        public void RenderChart()
+        {
+            var store = _scumControl.Measurements;
+            dataGridView1.RowCount = store.Count;
+            var empty = chart1.Series["Empty"];
+            if (store.Count == 0)
             {
-                chart1.Series["Empty"].Points.Clear();
+                chart1.Series["Volts"].Points.Clear();
+                chart1.Series["Amps"].Points.Clear();
+                if (empty.Points.Count == 0) DisplayEmptyChart();
+                return;
             }
-
-            chart1.DataBind();
+            empty.Points.Clear();
+
+            var axis = chart1.ChartAreas[0].AxisX;
+            store.Sort();
+            DateTime first = store.First;
+            DateTime last = store.Last;
+            axis.Minimum = first.ToOADate();
+            axis.Maximum = last.ToOADate();
+            DateTime from = first;
+            DateTime to = last;
+            if (axis.ScaleView.IsZoomed)
+            {
+                from = DateTime.FromOADate(axis.ScaleView.ViewMinimum);
+                to = DateTime.FromOADate(axis.ScaleView.ViewMaximum);
+            }
+            store.Decimate(from, to, chart1.Width, _voltsX, _volts, _ampsX, _amps);
+            chart1.Series["Volts"].Points.DataBindXY(_voltsX, _volts);
+            chart1.Series["Amps"].Points.DataBindXY(_ampsX, _amps);
         }
 
-        public void UpdateDataItem(DateTime dt, double volts, double amps)
+        private void DataGridViewCellValueNeeded(object sender, DataGridViewCellValueEventArgs e)
         {
-//            lstDataDisplay.Items.Add(new ListViewItem(new [] {dt.ToShortDateString(), dt.ToShortTimeString(), volts.ToString(), amps.ToString()}));
+            var store = _scumControl.Measurements;
+            if (e.RowIndex >= store.Count) return;
+            var m = store[e.RowIndex];
+            switch (e.ColumnIndex)
+            {
+                case 0:
+                case 1:
+                    e.Value = m.Timestamp;
+                    break;
+                case 2:
+                    e.Value = m.Volts;
+                    break;
+                case 3:
+                    e.Value = m.Amps;
+                    break;
+            }
         }
 
         // Update the graph with the data points
@@ -122,7 +183,7 @@ private void ButtonStartAcquisitionClick(object sender, EventArgs e)
         {
      //       _scumControl.StartAcquisition();
              // Set the time
-            _scumControl.SetDateTime();
+            _scumControl.SyncClock();
         }
 
         /// <summary> Update status bar. </summary>
@@ -157,15 +218,18 @@ private void btnDownloadData_Click(object sender, EventArgs e)
             _scumControl.RequestDataDownload();
         }
 
+        private void btnDownloadAlarms_Click(object sender, EventArgs e)
+        {
+            _scumControl.RequestAlarmDownload();
+        }
+
         private void chartControl_Load(object sender, EventArgs e)
         {
 
         }
 
-        private void btnSave_Click(object sender, EventArgs e)
+        private async void btnSave_Click(object sender, EventArgs e)
         {
-            var dlg = new SaveFileDialog();
-
             var saveFileDialog1 = new SaveFileDialog();
 
             saveFileDialog1.Filter = "csv files (*.csv)|*.csv|All files (*.*)|*.*"  ;
@@ -174,25 +238,26 @@ private void btnSave_Click(object sender, EventArgs e)
 
             if(saveFileDialog1.ShowDialog() == DialogResult.OK)
             {
+                btnSave.Enabled = false;
                 try
                 {
-                    using (var myStream = saveFileDialog1.OpenFile())
+                    // Exported from the cache, so make sure it is up to date.
+                    string cachePath = _scumControl.CachePath;
+                    _scumControl.Measurements.Save(cachePath);
+                    string fileName = saveFileDialog1.FileName;
+                    await Task.Run(() =>
                     {
-                        if (myStream == null) return;
-                        var sw = new StreamWriter(myStream);
-
-                        foreach (var m in _scumControl.BatteryMeasurementModel)
+                        using (var sw = new StreamWriter(fileName, false, new System.Text.UTF8Encoding(false), 1 << 16))
                         {
-                            sw.WriteLine("{0:d},{1:t},{2:0.00},{3:0.00}", m.Timestamp, m.Timestamp, m.Volts, m.Amps);
+                            MeasurementStore.ExportCsv(cachePath, sw);
                         }
-                        sw.Close();
-                        myStream.Close();
-                    }
+                    });
                 }
                 catch (Exception ex)
                 {
                     MessageBox.Show(ex.Message, "File Save Error", MessageBoxButtons.OK, MessageBoxIcon.Error);      
                 }
+                btnSave.Enabled = true;
             }
         }
 
@@ -206,5 +271,10 @@ private void button1_Click(object sender, EventArgs e)
             _scumControl.GetConfiguration();
         }
 
+        private void chkLive_CheckedChanged(object sender, EventArgs e)
+        {
+            _scumControl.SubscribeTelemetry(chkLive.Checked ? TelemetryFlags.Measurements : TelemetryFlags.None, 1000);
+        }
+
     }
 }
@@ -0,0 +1,399 @@
+﻿using System;
+using System.Collections.Generic;
+using System.Globalization;
+using System.IO;
+using System.IO.MemoryMappedFiles;
+
+namespace DataLogging
+{
+    // Columnar store of battery measurements.
+    // Timestamps, volts and amps are kept in separate arrays, so a year of
+    // readings is a few MB and can be scanned quickly for charting.
+    // Downloads add from the receive thread while the UI reads, so access is locked.
+    //
+    // The store can be saved to a cache file with the same columnar layout:
+    // a header, then capacity timestamps, capacity volts and capacity amps.
+    // Columns have room to grow, so new measurements are appended in place
+    // through a memory mapped view. Any other change writes a new file that
+    // replaces the old one, so an interrupted save never loses the cache.
+    public class MeasurementStore
+    {
+        private const int InitialCapacity = 4096;
+        private const uint FileMagic = 0x314D4353;  // "SCM1"
+        private const int FileVersion = 1;
+        private const int HeaderSize = 64;
+        private const int ExportChunk = 65536;      // Rows read from the cache at a time when exporting
+
+        private readonly object _lock = new object();
+        private long[] _ticks = new long[InitialCapacity];  // DateTime ticks
+        private float[] _volts = new float[InitialCapacity];
+        private float[] _amps = new float[InitialCapacity];
+        private int _count;
+        private bool _sorted = true;
+        private int _savedCount;        // Measurements already in the cache file
+        private long _fileCapacity;     // Measurements the cache file has room for
+        private long _fileCount;        // Measurements the cache file holds
+
+        public int Count
+        {
+            get { lock (_lock) return _count; }
+        }
+
+        public BatteryMeasurement this[int index]
+        {
+            get
+            {
+                lock (_lock)
+                {
+                    if (index < 0 || index >= _count) throw new ArgumentOutOfRangeException("index");
+                    return new BatteryMeasurement(new DateTime(_ticks[index]), _volts[index], _amps[index]);
+                }
+            }
+        }
+
+        // Time range of the store. Only valid if Count > 0.
+        public DateTime First
+        {
+            get { lock (_lock) return new DateTime(_ticks[0]); }
+        }
+
+        public DateTime Last
+        {
+            get { lock (_lock) return new DateTime(_ticks[_count - 1]); }
+        }
+
+        public void Add(DateTime timestamp, double volts, double amps)
+        {
+            lock (_lock)
+            {
+                if (_count == _ticks.Length)
+                {
+                    Array.Resize(ref _ticks, _count * 2);
+                    Array.Resize(ref _volts, _count * 2);
+                    Array.Resize(ref _amps, _count * 2);
+                }
+                if (_count > 0 && timestamp.Ticks < _ticks[_count - 1]) _sorted = false;
+                _ticks[_count] = timestamp.Ticks;
+                _volts[_count] = (float)volts;
+                _amps[_count] = (float)amps;
+                _count++;
+            }
+        }
+
+        public void Clear()
+        {
+            lock (_lock)
+            {
+                _count = 0;
+                _sorted = true;
+                _savedCount = 0;
+            }
+        }
+
+        // Remove measurements at or after from, so they can be downloaded again.
+        public void RemoveFrom(DateTime from)
+        {
+            lock (_lock)
+            {
+                Sort();
+                _count = LowerBound(from.Ticks);
+                _savedCount = Math.Min(_savedCount, _count);
+            }
+        }
+
+        // Replace the measurements at or after from with the downloaded ones.
+        // Done in one step once a download has completed, so a download that
+        // fails leaves the cached history as it was.
+        public void ReplaceFrom(DateTime from, MeasurementStore downloaded)
+        {
+            lock (_lock)
+            {
+                RemoveFrom(from);
+                lock (downloaded._lock)
+                {
+                    for (int i = 0; i < downloaded._count; i++)
+                    {
+                        Add(new DateTime(downloaded._ticks[i]), downloaded._volts[i], downloaded._amps[i]);
+                    }
+                }
+            }
+        }
+
+        // Put the measurements in time order.
+        // Log files aren't always downloaded in order, so call this once a download is complete.
+        public void Sort()
+        {
+            lock (_lock)
+            {
+                if (_sorted) return;
+                var order = new int[_count];
+                for (int i = 0; i < _count; i++) order[i] = i;
+                var keys = new long[_count];
+                Array.Copy(_ticks, keys, _count);
+                Array.Sort(keys, order);
+
+                var volts = new float[_ticks.Length];
+                var amps = new float[_ticks.Length];
+                for (int i = 0; i < _count; i++)
+                {
+                    volts[i] = _volts[order[i]];
+                    amps[i] = _amps[order[i]];
+                }
+                Array.Copy(keys, _ticks, _count);
+                _volts = volts;
+                _amps = amps;
+                _sorted = true;
+                // Rows have moved, so the whole cache needs writing
+                _savedCount = 0;
+            }
+        }
+
+        // Reduce the measurements between from and to to the minimum and maximum
+        // in each of columns equal slices of time, in time order.
+        // Plotting these looks the same as plotting every point, as each slice
+        // is one pixel column wide, but costs at most 2 points per column for each series.
+        // X values are OLE automation dates as used by the chart.
+        public void Decimate(DateTime from, DateTime to, int columns,
+            List<double> x, List<double> volts, List<double> ampsX, List<double> amps)
+        {
+            x.Clear();
+            volts.Clear();
+            ampsX.Clear();
+            amps.Clear();
+            lock (_lock)
+            {
+                Sort();
+                if (_count == 0 || columns <= 0 || to <= from) return;
+
+                int start = LowerBound(from.Ticks);
+                int end = LowerBound(to.Ticks + 1);
+                long slice = Math.Max(1, (to.Ticks - from.Ticks) / columns);
+                int i = start;
+                while (i < end)
+                {
+                    long sliceEnd = _ticks[i] - (_ticks[i] - from.Ticks) % slice + slice;
+                    int minV = i, maxV = i, minA = i, maxA = i;
+                    for (i++; i < end && _ticks[i] < sliceEnd; i++)
+                    {
+                        if (_volts[i] < _volts[minV]) minV = i;
+                        if (_volts[i] > _volts[maxV]) maxV = i;
+                        if (_amps[i] < _amps[minA]) minA = i;
+                        if (_amps[i] > _amps[maxA]) maxA = i;
+                    }
+                    AddExtremes(_volts, minV, maxV, x, volts);
+                    AddExtremes(_amps, minA, maxA, ampsX, amps);
+                }
+            }
+        }
+
+        private void AddExtremes(float[] values, int a, int b, List<double> x, List<double> y)
+        {
+            if (a > b)
+            {
+                int t = a; a = b; b = t;
+            }
+            x.Add(new DateTime(_ticks[a]).ToOADate());
+            y.Add(values[a]);
+            if (b != a)
+            {
+                x.Add(new DateTime(_ticks[b]).ToOADate());
+                y.Add(values[b]);
+            }
+        }
+
+        // Replace the store with the contents of a cache file.
+        // Returns false, leaving the store empty, if there is no valid cache.
+        public bool Load(string path)
+        {
+            lock (_lock)
+            {
+                Clear();
+                _fileCapacity = 0;
+                _fileCount = 0;
+                if (!File.Exists(path)) return false;
+                try
+                {
+                    using (var file = MemoryMappedFile.CreateFromFile(path, FileMode.Open, null, 0, MemoryMappedFileAccess.Read))
+                    using (var view = file.CreateViewAccessor(0, 0, MemoryMappedFileAccess.Read))
+                    {
+                        long count = view.ReadInt64(8);
+                        long capacity = view.ReadInt64(16);
+                        if (view.ReadUInt32(0) != FileMagic || view.ReadInt32(4) != FileVersion ||
+                            count < 0 || count > capacity || count > int.MaxValue ||
+                            view.Capacity < HeaderSize + capacity * 16)
+                        {
+                            return false;
+                        }
+                        int size = Math.Max(InitialCapacity, (int)count);
+                        _ticks = new long[size];
+                        _volts = new float[size];
+                        _amps = new float[size];
+                        view.ReadArray(HeaderSize, _ticks, 0, (int)count);
+                        view.ReadArray(HeaderSize + capacity * 8, _volts, 0, (int)count);
+                        view.ReadArray(HeaderSize + capacity * 12, _amps, 0, (int)count);
+                        _count = (int)count;
+                        _savedCount = _count;
+                        _fileCapacity = capacity;
+                        _fileCount = count;
+                    }
+                }
+                catch (IOException)
+                {
+                    Clear();
+                    return false;
+                }
+                return true;
+            }
+        }
+
+        // Write anything new to the cache file.
+        public void Save(string path)
+        {
+            lock (_lock)
+            {
+                Sort();
+                if (File.Exists(path) && _count <= _fileCapacity && _savedCount == _fileCount)
+                {
+                    // Only appending, so the rows already saved are left alone.
+                    WriteRows(path);
+                    return;
+                }
+                // Leave room to grow so the next saves can append
+                _fileCapacity = Math.Max(InitialCapacity, (long)_count * 2);
+                _savedCount = 0;
+                Directory.CreateDirectory(Path.GetDirectoryName(path));
+                string temp = path + ".tmp";
+                using (var stream = new FileStream(temp, FileMode.Create, FileAccess.ReadWrite))
+                {
+                    stream.SetLength(HeaderSize + _fileCapacity * 16);
+                }
+                WriteRows(temp);
+                if (File.Exists(path))
+                {
+                    File.Replace(temp, path, null);
+                }
+                else
+                {
+                    File.Move(temp, path);
+                }
+            }
+        }
+
+        // Write the unsaved rows, then the header.
+        private void WriteRows(string path)
+        {
+            using (var file = MemoryMappedFile.CreateFromFile(path, FileMode.Open))
+            using (var view = file.CreateViewAccessor())
+            {
+                int n = _count - _savedCount;
+                view.WriteArray(HeaderSize + (long)_savedCount * 8, _ticks, _savedCount, n);
+                view.WriteArray(HeaderSize + _fileCapacity * 8 + (long)_savedCount * 4, _volts, _savedCount, n);
+                view.WriteArray(HeaderSize + _fileCapacity * 12 + (long)_savedCount * 4, _amps, _savedCount, n);
+                // The count goes last, so an interrupted append leaves the old contents valid.
+                view.Write(0, FileMagic);
+                view.Write(4, FileVersion);
+                view.Write(16, _fileCapacity);
+                view.Write(8, (long)_count);
+                view.Flush();
+            }
+            _savedCount = _count;
+            _fileCount = _count;
+        }
+
+        // Write a cache file out as CSV.
+        // Reads the file through a memory mapped view a chunk at a time, so the
+        // whole history is never held as strings, and doesn't need the store lock.
+        public static void ExportCsv(string path, TextWriter writer)
+        {
+            using (var file = MemoryMappedFile.CreateFromFile(path, FileMode.Open, null, 0, MemoryMappedFileAccess.Read))
+            using (var view = file.CreateViewAccessor(0, 0, MemoryMappedFileAccess.Read))
+            {
+                if (view.ReadUInt32(0) != FileMagic || view.ReadInt32(4) != FileVersion) return;
+                long count = view.ReadInt64(8);
+                long capacity = view.ReadInt64(16);
+                var ticks = new long[ExportChunk];
+                var volts = new float[ExportChunk];
+                var amps = new float[ExportChunk];
+                var line = new CsvLineWriter(writer);
+                for (long start = 0; start < count; start += ExportChunk)
+                {
+                    int n = (int)Math.Min(ExportChunk, count - start);
+                    view.ReadArray(HeaderSize + start * 8, ticks, 0, n);
+                    view.ReadArray(HeaderSize + capacity * 8 + start * 4, volts, 0, n);
+                    view.ReadArray(HeaderSize + capacity * 12 + start * 4, amps, 0, n);
+                    for (int i = 0; i < n; i++)
+                    {
+                        line.Write(ticks[i], volts[i], amps[i]);
+                    }
+                }
+            }
+        }
+
+        // Writes "date,time,volts,amps" lines without formatting a string per line.
+        // The date and time only change once a minute, so their text is reused.
+        private class CsvLineWriter
+        {
+            private readonly TextWriter _writer;
+            private readonly char[] _number = new char[16];
+            private readonly string _decimal = NumberFormatInfo.CurrentInfo.NumberDecimalSeparator;
+            private long _minute = -1;
+            private string _prefix;
+
+            public CsvLineWriter(TextWriter writer)
+            {
+                _writer = writer;
+            }
+
+            public void Write(long ticks, float volts, float amps)
+            {
+                long minute = ticks / TimeSpan.TicksPerMinute;
+                if (minute != _minute)
+                {
+                    var timestamp = new DateTime(ticks);
+                    _prefix = String.Format("{0:d},{1:t},", timestamp, timestamp);
+                    _minute = minute;
+                }
+                _writer.Write(_prefix);
+                WriteHundredths(volts);
+                _writer.Write(',');
+                WriteHundredths(amps);
+                _writer.WriteLine();
+            }
+
+            // Same as formatting with "0.00"
+            private void WriteHundredths(float value)
+            {
+                long hundredths = (long)Math.Round(value * 100.0);
+                bool negative = hundredths < 0;
+                if (negative) hundredths = -hundredths;
+                int pos = _number.Length;
+                _number[--pos] = (char)('0' + hundredths % 10);
+                _number[--pos] = (char)('0' + hundredths / 10 % 10);
+                hundredths /= 100;
+                if (negative) _writer.Write('-');
+                int digits = pos;
+                do
+                {
+                    _number[--digits] = (char)('0' + hundredths % 10);
+                    hundredths /= 10;
+                } while (hundredths > 0);
+                _writer.Write(_number, digits, pos - digits);
+                _writer.Write(_decimal);
+                _writer.Write(_number, pos, 2);
+            }
+        }
+
+        // Index of the first measurement at or after ticks. Store must be sorted.
+        private int LowerBound(long ticks)
+        {
+            int lo = 0, hi = _count;
+            while (lo < hi)
+            {
+                int mid = (lo + hi) / 2;
+                if (_ticks[mid] < ticks) lo = mid + 1;
+                else hi = mid;
+            }
+            return lo;
+        }
+    }
+}
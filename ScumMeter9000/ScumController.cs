@@ -22,6 +22,8 @@
 using System.Threading;
 using System.ComponentModel;
 using System.Collections.ObjectModel;
+using System.IO;
+using System.Text;
 
 namespace DataLogging
 {
@@ -37,7 +39,43 @@ enum Command
         DataDownloadComplete, // Command from arduino indicating completion of the data download.
         kGetConfiguration,	// Get current config parameters
         kSetConfiguration,	// Set current config parameters
-        kConfigurationData	// Config data.
+        kConfigurationData,	// Config data.
+        RequestAlarmDownload, // Command to request the alarm history from arduino
+        AlarmDownloadItem,  // Command from arduino for an alarm
+        AlarmDownloadComplete, // Command from arduino indicating completion of the alarm download.
+        GetAlarmRule,       // Get an alarm rule
+        SetAlarmRule,       // Set an alarm rule
+        AlarmRuleData,      // Alarm rule data.
+        SyncClock,          // Sync the clock to the host time to the millisecond
+        ClockSyncData,      // Clock error and drift measured by the sync
+        GetEepromWear,      // Get the configuration write counts
+        EepromWearData,     // Writes to each configuration slot
+        SetBaudRate,        // Change the baud rate of the host link
+        DataDownloadCredit, // More items the host can take during a download
+        SubscribeTelemetry, // Start or stop pushing live data
+        TelemetryData,      // A new measurement
+        TelemetryRaw,       // Data received from the meter
+        GetDiagnostics,     // Get the memory, SD cache, log repair, telemetry and SPI bus stats
+        DiagnosticsData     // Memory, SD cache, log repair, telemetry and SPI bus stats
+    };
+
+    // What the controller pushes while subscribed. Matches TELEMETRY_xxx in SerialCommands.h
+    [Flags]
+    public enum TelemetryFlags
+    {
+        None = 0,
+        Measurements = 0x01,
+        Raw = 0x02
+    }
+
+    // Alarm rule types. Matches AL_RULE_xxx in Configuration.h
+    [Flags]
+    public enum AlarmRuleType
+    {
+        Disabled = 0,
+        Volts = 1,
+        Amps = 2,
+        Below = 0x80
     };
 
     public class BatteryMeasurement
@@ -55,6 +93,115 @@ public BatteryMeasurement(DateTime timestamp, double volts, double amps)
         }
     }
 
+    public class AlarmRule
+    {
+        public AlarmRuleType Type;
+        public short Threshold;     // Hundredths
+        public byte Hysteresis;
+        public byte Duration;       // Seconds
+        public byte RateLimit;      // Hundredths per hour
+
+        public AlarmRule(AlarmRuleType type, short threshold, byte hysteresis, byte duration, byte rateLimit)
+        {
+            Type = type;
+            Threshold = threshold;
+            Hysteresis = hysteresis;
+            Duration = duration;
+            RateLimit = rateLimit;
+        }
+
+        public override string ToString()
+        {
+            return String.Format("{0} Threshold {1} Hysteresis {2} Duration {3} Rate {4}",
+                Type, Threshold, Hysteresis, Duration, RateLimit);
+        }
+    }
+
+    // The controller configuration. Transferred as the binary blob
+    // ConfigurationClass::Blob in Configuration.h, which is packed and little endian.
+    public class DeviceConfiguration
+    {
+        public const byte Version = 2;
+        public const int MaxAlarmRules = 4;
+        private const int HeaderSize = 5;
+
+        public uint ScreenSaverTimeout;     // ms
+        public uint MeterPollFrequency;     // ms
+        public AlarmRule[] AlarmRules = new AlarmRule[MaxAlarmRules];
+        public uint LoggingFrequency;       // ms
+        public uint ClockSyncTime;          // Set by the controller. Ignored when uploaded.
+
+        public byte[] ToBlob()
+        {
+            var stream = new MemoryStream();
+            var writer = new BinaryWriter(stream);
+            writer.Write(Version);
+            writer.Write((byte)0);      // size, filled in below
+            writer.Write((byte)0);      // sequence, only used in EEPROM
+            writer.Write((ushort)0);    // crc, filled in below
+            writer.Write(ScreenSaverTimeout);
+            writer.Write(MeterPollFrequency);
+            foreach (var rule in AlarmRules)
+            {
+                writer.Write((byte)rule.Type);
+                writer.Write(rule.Threshold);
+                writer.Write(rule.Hysteresis);
+                writer.Write(rule.Duration);
+                writer.Write(rule.RateLimit);
+            }
+            writer.Write(LoggingFrequency);
+            writer.Write(ClockSyncTime);
+
+            byte[] blob = stream.ToArray();
+            blob[1] = (byte)(blob.Length - HeaderSize);
+            ushort crc = Crc16(blob, 0, 3, 0xFFFF);
+            crc = Crc16(blob, HeaderSize, blob.Length - HeaderSize, crc);
+            blob[3] = (byte)crc;
+            blob[4] = (byte)(crc >> 8);
+            return blob;
+        }
+
+        // Returns null if the blob is invalid or from a newer controller.
+        public static DeviceConfiguration FromBlob(byte[] blob)
+        {
+            if (blob == null || blob.Length < HeaderSize || blob[0] != Version || blob[1] != blob.Length - HeaderSize)
+            {
+                return null;
+            }
+            ushort crc = Crc16(blob, 0, 3, 0xFFFF);
+            crc = Crc16(blob, HeaderSize, blob.Length - HeaderSize, crc);
+            if (crc != BitConverter.ToUInt16(blob, 3))
+            {
+                return null;
+            }
+
+            var reader = new BinaryReader(new MemoryStream(blob, HeaderSize, blob.Length - HeaderSize));
+            var config = new DeviceConfiguration();
+            config.ScreenSaverTimeout = reader.ReadUInt32();
+            config.MeterPollFrequency = reader.ReadUInt32();
+            for (int i = 0; i < MaxAlarmRules; i++)
+            {
+                config.AlarmRules[i] = new AlarmRule((AlarmRuleType)reader.ReadByte(), reader.ReadInt16(),
+                    reader.ReadByte(), reader.ReadByte(), reader.ReadByte());
+            }
+            config.LoggingFrequency = reader.ReadUInt32();
+            config.ClockSyncTime = reader.ReadUInt32();
+            return config;
+        }
+
+        // CRC-16/CCITT as calculated by _crc_ccitt_update on the controller.
+        private static ushort Crc16(byte[] data, int offset, int length, ushort crc)
+        {
+            for (int i = offset; i < offset + length; i++)
+            {
+                byte d = (byte)(data[i] ^ (byte)crc);
+                d ^= (byte)(d << 4);
+                crc = (ushort)((((ushort)d << 8) | (crc >> 8)) ^ (byte)(d >> 4) ^ ((ushort)d << 3));
+            }
+            return crc;
+        }
+    }
+
 
     public class ScumController
     {
@@ -62,28 +209,43 @@ public class ScumController
         private bool _USE_FILE_TRANSPORT = true;
         private const string UniqueDeviceId = "F21089D968C34F2E97F34FA6EB5AEDCA";
 
+        // Baud rate the controller starts at. Matches LINK_DEFAULT_BAUD.
+        private const int DefaultBaudRate = 115200;
+        // Faster rates to try, fastest first. The controller's UART divides these exactly.
+        private static readonly int[] FastBaudRates = { 1000000, 500000, 250000 };
+        // Time the controller waits for a new rate to be confirmed. Matches LINK_CONFIRM_TIMEOUT.
+        private const int LinkConfirmTimeout = 2000;
+        // Download items the controller may send before it must wait for more credit.
+        private const int DownloadWindow = 64;
+        private int _downloadItemsSinceCredit;
+        // Items of the download in progress. Only merged into the cache once it completes.
+        private volatile MeasurementStore _download;
+        private DateTime _downloadFrom;
+        // Sequence number expected in the next telemetry frame
+        private int _telemetrySequence;
+
         private ITransport            _transport;
         private CmdMessenger          _cmdMessenger;
         private ConnectionManager     _connectionManager;
         private ChartForm             _chartForm;
 
 
-        public BindingList<BatteryMeasurement> _batteryMeasurementModel = new BindingList<BatteryMeasurement>();
+        private readonly MeasurementStore _measurements = new MeasurementStore();
 
-        public BindingList<BatteryMeasurement> BatteryMeasurementModel
+        public MeasurementStore Measurements
         {
-            get { return _batteryMeasurementModel; }
+            get { return _measurements; }
         }
-        //public ObservableCollection<BatteryMeasurement> BatteryMeasurementModel
-        //{
-        //    get { return _batteryMeasurementModel; }
-        //}
-        //// ------------------ MAIN  ----------------------
 
-        // TODO: put some bool in here for when we are downloading data
-        // to make sure we clean up if there is a transfer error.
-        //public bool AcquisitionStarted { get; set; }
-        
+        // Downloaded history for the device, so only new data needs downloading.
+        public string CachePath
+        {
+            get
+            {
+                return Path.Combine(Environment.GetFolderPath(Environment.SpecialFolder.LocalApplicationData),
+                    "ScumMeter9000", UniqueDeviceId + ".cache");
+            }
+        }
 
         // Setup function
         public void Setup(ChartForm chartForm)
@@ -154,6 +316,12 @@ public void Setup(ChartForm chartForm)
             // Initialize the application
             Initialize(); 
 
+            // Show what was downloaded last time straight away
+            if (_measurements.Load(CachePath))
+            {
+                _chartForm.EndDataDownload();
+            }
+
             // Start scanning for ports/devices
             if (!_OFFLINE_TESTING)
                 _connectionManager.StartConnectionManager();           
@@ -192,10 +360,14 @@ private void AttachCommandCallBacks()
             _cmdMessenger.Attach(OnUnknownCommand);
             _cmdMessenger.Attach((int)Command.Acknowledge, OnAcknowledge);
             _cmdMessenger.Attach((int)Command.Error, OnError);
-            _cmdMessenger.Attach((int)Command.DataDownloadItem, OnDataDownloadItem);
+            // Decoded as they arrive. Invoking each one on the UI thread would swamp it.
+            _cmdMessenger.AttachOnReceiveThread((int)Command.DataDownloadItem, OnDataDownloadItem);
             //_cmdMessenger.Attach((int)Command.DataDownloadStart, OnDataDownloadStart);
             _cmdMessenger.Attach((int)Command.DataDownloadComplete, OnDataDownloadEnd);
-//            _cmdMessenger.Attach((int)Command.kConfigurationData, OnReceiveConfiguration); 
+            _cmdMessenger.Attach((int)Command.AlarmDownloadItem, OnAlarmDownloadItem);
+            _cmdMessenger.Attach((int)Command.AlarmDownloadComplete, OnAlarmDownloadEnd);
+            _cmdMessenger.Attach((int)Command.TelemetryData, OnTelemetryData);
+            _cmdMessenger.Attach((int)Command.TelemetryRaw, OnTelemetryRaw);
         }
 
         // ------------------  CALLBACKS ---------------------
@@ -234,6 +406,21 @@ private void OnDataDownloadEnd(ReceivedCommand arguments)
         {           
             // TODO: Set a Flag so that EndDataDownload is always called, even on errors.
 
+            var download = _download;
+            _download = null;
+            if (download != null)
+            {
+                _measurements.ReplaceFrom(_downloadFrom, download);
+            }
+            try
+            {
+                _measurements.Save(CachePath);
+            }
+            catch (IOException ex)
+            {
+                // Still in memory, and will be saved with the next download.
+                _chartForm.LogMessage(@"Unable to update the download cache: " + ex.Message);
+            }
             _chartForm.EndDataDownload();
         }
 
@@ -258,16 +445,245 @@ public bool SetDateTime()
             return receivedCommand.Ok;
         }
 
+        // Sync the clock on the embedded controller to the millisecond.
+        // The controller uses the error since the last sync to trim the drift of its RTC.
+        public bool SyncClock()
+        {
+            // The controller keeps local time, so treat local time as if it were UTC
+            DateTime now = DateTime.Now;
+            long ms = (long)(now - new DateTime(1970, 1, 1, 0, 0, 0, 0)).TotalMilliseconds;
+            var command = new SendCommand((int)Command.SyncClock, (int)Command.ClockSyncData, 3000);
+            command.AddArgument((UInt32)(ms / 1000));
+            command.AddArgument((Int16)(ms % 1000));
+
+            var receivedCommand = _cmdMessenger.SendCommand(command);
+
+            if (!receivedCommand.Ok)
+            {
+                _chartForm.LogMessage(@" Failure > no OK received from controller");
+                return false;
+            }
+            int error = receivedCommand.ReadInt32Arg();
+            double drift = receivedCommand.ReadInt16Arg() / 10.0;
+            int aging = receivedCommand.ReadInt16Arg();
+            _chartForm.LogMessage(String.Format("Clock was {0}ms out. Drift {1:0.0}ppm, aging offset {2}", error, drift, aging));
+            return true;
+        }
+
+        // Move the link to the fastest baud rate both ends can manage.
+        // The controller acknowledges a new rate at the old one, then the host
+        // confirms it at the new rate. If the confirmation doesn't get through,
+        // the controller goes back to the default rate on its own.
+        public bool NegotiateBaudRate()
+        {
+            var serialTransport = _transport as SerialTransport;
+            if (serialTransport == null) return false;
+
+            foreach (int baudRate in FastBaudRates)
+            {
+                if (!SendBaudRate(baudRate)) continue;
+                if (ChangeBaudRate(serialTransport, baudRate) && SendBaudRate(baudRate))
+                {
+                    _chartForm.LogMessage(String.Format("Link running at {0} baud", baudRate));
+                    return true;
+                }
+                // Wait for the controller to give up on the new rate, then follow it back.
+                Thread.Sleep(LinkConfirmTimeout);
+                ChangeBaudRate(serialTransport, DefaultBaudRate);
+            }
+            return false;
+        }
+
+        private bool SendBaudRate(int baudRate)
+        {
+            var command = new SendCommand((int)Command.SetBaudRate, (int)Command.Acknowledge, 500);
+            command.AddArgument((UInt32)baudRate);
+            var receivedCommand = _cmdMessenger.SendCommand(command);
+            return receivedCommand.Ok && receivedCommand.ReadUInt32Arg() == baudRate;
+        }
+
+        private bool ChangeBaudRate(SerialTransport serialTransport, int baudRate)
+        {
+            _cmdMessenger.Disconnect();
+            serialTransport.CurrentSerialSettings.BaudRate = baudRate;
+            return _cmdMessenger.Connect();
+        }
+
+        // Start or stop live data from the embedded controller.
+        // Measurements come no faster than intervalMs apart.
+        public bool SubscribeTelemetry(TelemetryFlags flags, int intervalMs)
+        {
+            var command = new SendCommand((int)Command.SubscribeTelemetry, (int)Command.Acknowledge, 500);
+            command.AddArgument((Int16)flags);
+            command.AddArgument((UInt16)intervalMs);
+            _telemetrySequence = 0;
+            var receivedCommand = _cmdMessenger.SendCommand(command);
+
+            if (!receivedCommand.Ok)
+            {
+                _chartForm.LogMessage(@" Failure > no OK received from controller");
+                return false;
+            }
+            return true;
+        }
+
+        // A live measurement. See SerialCommandsClass::TelemetryFrame.
+        private void OnTelemetryData(ReceivedCommand arguments)
+        {
+            var frame = Encoding.GetEncoding("ISO-8859-1").GetBytes(arguments.ReadBinStringArg());
+            if (frame.Length != 14) return;
+            using (var reader = new BinaryReader(new MemoryStream(frame)))
+            {
+                int sequence = reader.ReadUInt16();
+                uint timestamp = reader.ReadUInt32();
+                int ms = reader.ReadUInt16();
+                short volts = reader.ReadInt16();
+                short amps = reader.ReadInt16();
+                reader.ReadInt16(); // power
+
+                // The controller drops frames rather than wait for us
+                int dropped = (sequence - _telemetrySequence) & 0xFFFF;
+                if (dropped != 0)
+                {
+                    _chartForm.LogMessage(String.Format("{0} live measurements dropped", dropped));
+                }
+                _telemetrySequence = (sequence + 1) & 0xFFFF;
+
+                // -1 if the meter value wasn't read
+                if (volts < 0 || amps < 0) return;
+                var dtDateTime = new DateTime(1970, 1, 1, 0, 0, 0, 0, DateTimeKind.Utc).AddSeconds(timestamp).AddMilliseconds(ms);
+                _measurements.Add(dtDateTime, volts / 100.0, amps / 100.0);
+                _chartForm.UpdateDataItem(dtDateTime, volts / 100.0, amps / 100.0, true);
+            }
+        }
+
+        private void OnTelemetryRaw(ReceivedCommand arguments)
+        {
+            _chartForm.LogMessage(@"Meter: " + arguments.ReadBinStringArg().Trim());
+        }
+
+        // Rated write endurance of the ATmega328 EEPROM
+        private const int EepromEndurance = 100000;
+
+        // Report how worn the configuration EEPROM on the embedded controller is.
+        // Writes are spread over the slots, so the most written slot limits its life.
+        public bool GetEepromWear()
+        {
+            var command = new SendCommand((int)Command.GetEepromWear, (int)Command.EepromWearData, 1000);
+            var receivedCommand = _cmdMessenger.SendCommand(command);
+
+            if (!receivedCommand.Ok)
+            {
+                _chartForm.LogMessage(@" Failure > no OK received from controller");
+                return false;
+            }
+            int slots = 0;
+            int total = 0;
+            int max = 0;
+            while (receivedCommand.Next())
+            {
+                int writes = receivedCommand.ReadUInt16Arg();
+                slots++;
+                total += writes;
+                max = Math.Max(max, writes);
+            }
+            _chartForm.LogMessage(String.Format("Configuration saved {0} times over {1} slots. {2:0.0}% of EEPROM life used",
+                total, slots, max * 100.0 / EepromEndurance));
+            return true;
+        }
+
+        // Report the SRAM, SD block cache, log repairs and SPI bus use of the embedded controller.
+        // The stack headroom is the least free RAM there has been since it started.
+        public bool GetDiagnostics()
+        {
+            var command = new SendCommand((int)Command.GetDiagnostics, (int)Command.DiagnosticsData, 1000);
+            var receivedCommand = _cmdMessenger.SendCommand(command);
+
+            if (!receivedCommand.Ok)
+            {
+                _chartForm.LogMessage(@" Failure > no OK received from controller");
+                return false;
+            }
+            int freeRam = receivedCommand.ReadUInt16Arg();
+            int stackHeadroom = receivedCommand.ReadUInt16Arg();
+            int staticRam = receivedCommand.ReadUInt16Arg();
+            int tmpbufUsed = receivedCommand.ReadUInt16Arg();
+            int tmpbufSize = receivedCommand.ReadUInt16Arg();
+            _chartForm.LogMessage(String.Format("RAM: {0} bytes static, {1} free, {2} stack headroom. TMPBUF used {3} of {4}",
+                staticRam, freeRam, stackHeadroom, tmpbufUsed, tmpbufSize));
+            ulong cacheHits = receivedCommand.ReadUInt32Arg();
+            ulong cacheMisses = receivedCommand.ReadUInt32Arg();
+            if (cacheHits + cacheMisses > 0)
+            {
+                _chartForm.LogMessage(String.Format("SD cache: {0} hits, {1} misses ({2:0.0}% hit rate)",
+                    cacheHits, cacheMisses, cacheHits * 100.0 / (cacheHits + cacheMisses)));
+            }
+            int tornBytes = receivedCommand.ReadUInt16Arg();
+            int freedClusters = receivedCommand.ReadUInt16Arg();
+            int skippedRecords = receivedCommand.ReadUInt16Arg();
+            if (tornBytes + freedClusters + skippedRecords > 0)
+            {
+                _chartForm.LogMessage(String.Format("Log repairs: {0} bytes of cut short lines removed, {1} lost clusters freed, {2} corrupt lines skipped",
+                    tornBytes, freedClusters, skippedRecords));
+            }
+            int rawDropped = receivedCommand.ReadUInt16Arg();
+            if (rawDropped > 0)
+            {
+                _chartForm.LogMessage(String.Format("Live raw data: {0} chunks dropped", rawDropped));
+            }
+            ulong busSwitches = receivedCommand.ReadUInt32Arg();
+            var devices = new StringBuilder();
+            while (receivedCommand.Next())
+            {
+                int csPin = receivedCommand.ReadUInt16Arg();
+                ulong selects = receivedCommand.ReadUInt32Arg();
+                ulong busyMs = receivedCommand.ReadUInt32Arg();
+                devices.AppendFormat(" Pin {0}: {1} selects, {2}ms busy.", csPin, selects, busyMs);
+            }
+            _chartForm.LogMessage(String.Format("SPI bus: {0} switches between devices.{1}", busSwitches, devices));
+            return true;
+        }
+
         // Upload the default configuration
         public bool SetDefaultConfiguration()
+        {
+            var config = new DeviceConfiguration();
+            config.ScreenSaverTimeout = 60000; // 1 minute
+            config.MeterPollFrequency = 5000; // 5 secs
+            config.LoggingFrequency = 30000; // 30 secs
+            // Values are in hundredths. Min volts ignores dips shorter than 10 seconds (e.g. cranking)
+            // and also alarms if the voltage is falling faster than 0.5V per hour.
+            config.AlarmRules[0] = new AlarmRule(AlarmRuleType.Volts, 1600, 20, 0, 0);
+            config.AlarmRules[1] = new AlarmRule(AlarmRuleType.Volts | AlarmRuleType.Below, 1200, 20, 10, 50);
+            config.AlarmRules[2] = new AlarmRule(AlarmRuleType.Amps, 1000, 50, 0, 0);
+            config.AlarmRules[3] = new AlarmRule(AlarmRuleType.Disabled, 0, 0, 0, 0);
+            return SetConfiguration(config);
+        }
+
+        // The controller rejects the whole configuration if any of it is invalid.
+        public bool SetConfiguration(DeviceConfiguration config)
         {
             var command = new SendCommand((int)Command.kSetConfiguration, (int)Command.Acknowledge, 500);
-            command.AddArgument(60); // 1 minute
-            command.AddArgument(5); // 5 secs
-            command.AddArgument(30); // 30 secs
-            command.AddArgument("16"); // maxVolts
-            command.AddArgument("12"); // minVolts
-            command.AddArgument("10"); // maxAmps
+            command.AddBinArgument(Encoding.GetEncoding("ISO-8859-1").GetString(config.ToBlob()));
+
+            var receivedCommand = _cmdMessenger.SendCommand(command);
+
+            if (!receivedCommand.Ok)
+            {
+                _chartForm.LogMessage(@" Failure > no OK received from controller");
+            }
+            return receivedCommand.Ok;
+        }
+
+        public bool SetAlarmRule(int index, AlarmRuleType type, int threshold, int hysteresis, int duration, int rateLimit)
+        {
+            var command = new SendCommand((int)Command.SetAlarmRule, (int)Command.Acknowledge, 500);
+            command.AddArgument(index);
+            command.AddArgument((int)type);
+            command.AddArgument(threshold);
+            command.AddArgument(hysteresis);
+            command.AddArgument(duration);
+            command.AddArgument(rateLimit);
 
             var receivedCommand = _cmdMessenger.SendCommand(command);
 
@@ -289,54 +705,69 @@ public bool GetConfiguration()
             }
             else
             {
-                _chartForm.LogMessage(String.Format("Display Timeout {0}", receivedCommand.ReadUInt32Arg()));
-                _chartForm.LogMessage(String.Format("Meter Poll Interval {0}", receivedCommand.ReadUInt32Arg()));
-                _chartForm.LogMessage(String.Format("Data Log Interval {0}", receivedCommand.ReadUInt32Arg()));
-                _chartForm.LogMessage(String.Format("Max Volts {0}", receivedCommand.ReadStringArg()));
-                _chartForm.LogMessage(String.Format("Min Volts {0}", receivedCommand.ReadStringArg()));
-                _chartForm.LogMessage(String.Format("Max Amps {0}", receivedCommand.ReadStringArg()));
+                var blob = Encoding.GetEncoding("ISO-8859-1").GetBytes(receivedCommand.ReadBinStringArg());
+                var config = DeviceConfiguration.FromBlob(blob);
+                if (config == null)
+                {
+                    _chartForm.LogMessage(@" Failure > invalid configuration received from controller");
+                    return false;
+                }
+                _chartForm.LogMessage(String.Format("Display Timeout {0}", config.ScreenSaverTimeout / 1000));
+                _chartForm.LogMessage(String.Format("Meter Poll Interval {0}", config.MeterPollFrequency / 1000));
+                _chartForm.LogMessage(String.Format("Data Log Interval {0}", config.LoggingFrequency / 1000));
+                for (int i = 0; i < DeviceConfiguration.MaxAlarmRules; i++)
+                {
+                    _chartForm.LogMessage(String.Format("Alarm Rule {0}: {1}", i, config.AlarmRules[i]));
+                }
             }
             return receivedCommand.Ok;
         }
 
-        void OnReceiveConfiguration(ReceivedCommand arguments)
-        {
-            _chartForm.LogMessage(String.Format("Display Timeout {0}", arguments.ReadUInt32Arg()));
-            _chartForm.LogMessage(String.Format("Meter Poll Interval {0}", arguments.ReadUInt32Arg()));
-            _chartForm.LogMessage(String.Format("Data Log Interval {0}", arguments.ReadUInt32Arg()));
-            _chartForm.LogMessage(String.Format("Max Volts {0}", arguments.ReadStringArg()));
-            _chartForm.LogMessage(String.Format("Min Volts {0}", arguments.ReadStringArg()));
-            _chartForm.LogMessage(String.Format("Max Amps {0}", arguments.ReadStringArg()));
-        }
-
+        // Download the history that isn't in the cache yet.
+        // The controller logs a file per month, so the last month in the cache
+        // is downloaded again in case it has been added to.
         public bool RequestDataDownload()
         {
-            _batteryMeasurementModel.Clear();
+            int startMonth = 0;
+            var from = DateTime.MinValue;
+            if (_measurements.Count > 0)
+            {
+                var last = _measurements.Last;
+                from = new DateTime(last.Year, last.Month, 1);
+                startMonth = from.Year * 100 + from.Month;
+            }
 
             if (_OFFLINE_TESTING)
             {
+                _measurements.Clear();
                 for (int i = 0; i < 1000; i++)
                 {
-                    _batteryMeasurementModel.Add(new BatteryMeasurement(DateTime.Now.AddMinutes(i * 15), i % 20, (i + 1) % 40));
-                    _chartForm.EndDataDownload();
+                    _measurements.Add(DateTime.Now.AddMinutes(i * 15), i % 20, (i + 1) % 40);
                 }
+                _chartForm.EndDataDownload();
                 return true;
             }
             var command = new SendCommand((int)Command.RequestDataDownload, (int)Command.DataDownloadStart, 500);
-            // Download all values.
-            command.AddArgument(0);
+            // Download from the start month onwards. yyyymm
+            command.AddArgument(startMonth);
             command.AddArgument(999999);
+            command.AddArgument((Int16)DownloadWindow);
+            _downloadItemsSinceCredit = 0;
+            // The cached months from startMonth on are replaced when the download completes.
+            _downloadFrom = from;
+            _download = new MeasurementStore();
             var receivedCommand = _cmdMessenger.SendCommand(command, SendQueue.ClearQueue, ReceiveQueue.ClearQueue);
             if (!receivedCommand.Ok)
             {
+                _download = null;
                 _chartForm.LogMessage(@" Failure > no OK received from controller");
             }
-            _batteryMeasurementModel.Clear();
             _chartForm.BeginDataDownload();
             return receivedCommand.Ok;
         }
 
 
+        // Called on the receive thread, so must not touch the UI.
         private void OnDataDownloadItem(ReceivedCommand arguments)
         {
             ulong timestamp = arguments.ReadUInt32Arg();
@@ -344,14 +775,55 @@ private void OnDataDownloadItem(ReceivedCommand arguments)
             dtDateTime = dtDateTime.AddSeconds(timestamp);
             double volts = arguments.ReadDoubleArg();            
             double amps = arguments.ReadDoubleArg();
-            BatteryMeasurementModel.Add(new BatteryMeasurement(dtDateTime, volts, amps));
-            _chartForm.UpdateDataItem(dtDateTime, volts, amps);
+            arguments.ReadDoubleArg(); // power
+            dtDateTime = dtDateTime.AddMilliseconds(arguments.ReadUInt16Arg()); // 0 for older logs
+            var download = _download;
+            if (download != null)
+            {
+                download.Add(dtDateTime, volts, amps);
+            }
+
+            // Hand back credit as items are used, so the controller can't get
+            // more than a window ahead of us.
+            if (++_downloadItemsSinceCredit >= DownloadWindow / 2)
+            {
+                _downloadItemsSinceCredit = 0;
+                _cmdMessenger.QueueCommand(new SendCommand((int)Command.DataDownloadCredit, (Int16)(DownloadWindow / 2)));
+            }
         }
 
 
+        // Request the alarm history. Alarms are sent most recent first.
+        public bool RequestAlarmDownload()
+        {
+            var command = new SendCommand((int)Command.RequestAlarmDownload, (int)Command.DataDownloadStart, 500);
+            var receivedCommand = _cmdMessenger.SendCommand(command, SendQueue.ClearQueue, ReceiveQueue.ClearQueue);
+            if (!receivedCommand.Ok)
+            {
+                _chartForm.LogMessage(@" Failure > no OK received from controller");
+            }
+            return receivedCommand.Ok;
+        }
+
+        private void OnAlarmDownloadItem(ReceivedCommand arguments)
+        {
+            ulong timestamp = arguments.ReadUInt32Arg();
+            System.DateTime dtDateTime = new DateTime(1970, 1, 1, 0, 0, 0, 0, System.DateTimeKind.Utc);
+            dtDateTime = dtDateTime.AddSeconds(timestamp);
+            string message = arguments.ReadStringArg();
+            _chartForm.LogMessage(String.Format("Alarm {0:g} {1}", dtDateTime, message));
+        }
+
+        private void OnAlarmDownloadEnd(ReceivedCommand arguments)
+        {
+            _chartForm.LogMessage(@"Alarm download complete");
+        }
+
         // Log received line to console
         private void NewLineReceived(object sender, CommandEventArgs e)
         {
+            // Far too many to log
+            if (e.Command.CmdId == (int)Command.DataDownloadItem) return;
             _chartForm.LogMessage(@"Received > " + e.Command.CommandString());
           //  Console.WriteLine(@"Received > " + e.Command.CommandString());
         }
@@ -389,6 +861,11 @@ private void ConnectionFound(object sender, EventArgs e)
             // Send command to set goal Temperature
             // SetGoalTemperature(_goalTemperature);
             // SetDateTime();
+            NegotiateBaudRate();
+            SyncClock();
+            GetEepromWear();
+            GetDiagnostics();
+            RequestDataDownload();
 
             // Yield time slice in order to get UI updated
             Thread.Yield();
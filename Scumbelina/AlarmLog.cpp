@@ -4,63 +4,174 @@
 
 #include "AlarmLog.h"
 #include "Configuration.h"
+#include "DataLogger.h"
+static const char ERROR_NO_READING[] PROGMEM = "no meter";
+static const char ERROR_NO_SD_CARD[] PROGMEM = "Insert SD";
+static const char ERROR_NO_FILE[] PROGMEM = "SD r/w Error";
+
 AlarmLogClass::AlarmLogClass() {
 	clearAllAlarms();
 }
 
-void AlarmLogClass::raiseAlarm(byte trigger, time_t timestamp, const __FlashStringHelper* msg, const char* limit, const MeterReading *value) {
-	if (alarmCount == MAX_ALARMS) {
-		// Shuffle alarms up by one, deleting the oldest one.
-		memcpy(alarms, &alarms[1], sizeof(Alarm) * (MAX_ALARMS - 1));
-		alarmCount = MAX_ALARMS - 1;
-	}
-	alarms[alarmCount].timestamp = timestamp;
-	strlcpy_P(alarms[alarmCount].message, (const char *) msg, sizeof(alarms[0].message));
-	if (limit && value) {
-		TMPBUF_ACQUIRE;
-		value->toString(TMPBUF, 2, 1);
-
-		substituteString(alarms[alarmCount].message, limit, '%');
-		substituteString(alarms[alarmCount].message, TMPBUF, '#');
-		TMPBUF_RELEASE;
+void AlarmLogClass::raiseAlarm(byte trigger, time_t timestamp, uint8_t type, int16_t threshold, int16_t value) {
+	// Overwrite the oldest alarm rather than shuffling the array.
+	// Older alarms are still available from the journal on the SD card.
+	Alarm& alarm = alarms[alarmHead];
+	alarm.type = type;
+	alarm.threshold = threshold;
+	alarm.value = value;
+	alarm.timestamp = timestamp;
+	alarmHead = (alarmHead + 1) % MAX_ALARMS;
+	if (alarmCount < MAX_ALARMS) {
+		alarmCount++;
 	}
-	alarmCount++;
 	triggered[trigger] = true;
 	newAlarm = true;
+	DataLogger.logAlarm(alarm);
+}
+
+//
+// Writes hundredths with num_dec (1 or 2) decimals and as many integer
+// digits as the value needs. Returns the end of the string.
+//
+static char* formatHundredths(char* c, int16_t hundredths, uint8_t num_dec) {
+	uint16_t value = hundredths < 0 ? -(int32_t)hundredths : hundredths;
+	if (num_dec == 1) value /= 10;
+	if (hundredths < 0 && value != 0) *c++ = '-';
+	char digits[5];
+	uint8_t n = 0;
+	do {
+		digits[n++] = '0' + value % 10;
+		value /= 10;
+	} while (value != 0 || n <= num_dec);
+	while (n > 0) {
+		if (n == num_dec) *c++ = '.';
+		*c++ = digits[--n];
+	}
+	*c = 0;
+	return c;
+}
+
+//
+// Message is "Volt>15.0 [15.2]" for a threshold alarm or
+// "Volt<<0.05 [0.12]" for a rate alarm, in units per hour.
+//
+void AlarmLogClass::formatAlarm(char* buf, const Alarm& alarm) const {
+	uint8_t metric = alarm.type & AL_RULE_METRIC_MASK;
+	if (metric == AL_RULE_DISABLED) {
+		const char* msg = ERROR_NO_FILE;
+		if (alarm.type == AL_MSG_NO_METER) msg = ERROR_NO_READING;
+		else if (alarm.type == AL_MSG_NO_SD_CARD) msg = ERROR_NO_SD_CARD;
+		strlcpy_P(buf, msg, ALARM_MESSAGE_LEN);
+		return;
+	}
+
+	strlcpy_P(buf, (const char*)(metric == AL_RULE_VOLTS ? F("Volt") : F("Amp")), ALARM_MESSAGE_LEN);
+	char* c = buf + strlen(buf);
+	bool rate = alarm.type & AL_ALARM_RATE;
+	*c++ = (alarm.type & AL_RULE_BELOW) ? '<' : '>';
+	if (rate) {
+		*c = c[-1];
+		c++;
+	}
+	uint8_t numDec = rate ? 2 : 1;
+	c = formatHundredths(c, alarm.threshold, numDec);
+	*c++ = ' ';
+	*c++ = '[';
+	c = formatHundredths(c, alarm.value, numDec);
+	*c++ = ']';
+	*c = 0;
 }
 
 void AlarmLogClass::newMeasurement(const BatteryMeasurement& value) {
 	if (!value.is_set) return;
 
-	const char* maxVolts = Configuration.getConfig().maxVolts;
-	const char* minVolts = Configuration.getConfig().minVolts;
-	const char* maxAmps = Configuration.getConfig().maxAmps;
+	int16_t readings[AL_RULE_METRICS] = { value.volts.toHundredths(), value.amps.toHundredths() };
+	for (uint8_t i = 0; i < AL_RULE_METRICS; i++) {
+		updateRate(rates[i], readings[i], value.timestamp);
+	}
 
-	if (!triggered[AL_MAXVOLT_TRIGGER] && value.volts > MeterReading(maxVolts)) {
-		raiseAlarm(AL_MAXVOLT_TRIGGER, value.timestamp, F("Volt > %% [####] "), maxVolts, &value.volts);
+	const ConfigurationClass::AlarmRule* rules = Configuration.getConfig().alarmRules;
+	for (uint8_t i = 0; i < MAX_ALARM_RULES; i++) {
+		uint8_t metric = rules[i].type & AL_RULE_METRIC_MASK;
+		if (metric == AL_RULE_DISABLED || metric > AL_RULE_METRICS) continue;
+		if (readings[metric - 1] < 0) continue;	// Bad reading from the meter
+		evaluateRule(i, readings[metric - 1], rates[metric - 1].rate, value.timestamp);
 	}
-	if (!triggered[AL_MINVOLT_TRIGGER] && value.volts  < MeterReading(minVolts)) {
-		raiseAlarm(AL_MINVOLT_TRIGGER, value.timestamp, F("Volt < %% [####] "), minVolts, &value.volts);
- 	}
-	if (!triggered[AL_MAXAMP_TRIGGER] && value.amps > MeterReading(maxAmps)) {
-		raiseAlarm(AL_MAXAMP_TRIGGER, value.timestamp, F("Amp > %% [####] "), maxAmps, &value.amps);
+}
+
+//
+// The rate is measured over at least AL_RATE_WINDOW seconds
+// so a single noisy reading doesn't trigger a rate alarm.
+// Going by the window the smallest rate seen is 0.06 per hour.
+//
+void AlarmLogClass::updateRate(MetricRate& metric, int16_t value, time_t timestamp) {
+	if (value < 0) return;
+	if (metric.refTime == 0) {
+		metric.refValue = value;
+		metric.refTime = timestamp;
+		return;
+	}
+	int32_t elapsed = timestamp - metric.refTime;
+	if (elapsed >= AL_RATE_WINDOW) {
+		int32_t change = (int32_t)value - metric.refValue;
+		if (labs(change) <= AL_RATE_DEADBAND) {
+			change = 0;
+		}
+		int32_t rate = change * 3600 / elapsed;
+		metric.rate = (int16_t)(rate > 0x7FFF ? 0x7FFF : (rate < -0x7FFF ? -0x7FFF : rate));
+		metric.refValue = value;
+		metric.refTime = timestamp;
 	}
 }
 
-void AlarmLogClass::substituteString(char* str, const char* val, const char replaceChar)  const {
-	while (*str) {
-		if (*str == replaceChar) {
-			if (*val == 0) return;
-			*str = *val++;
+void AlarmLogClass::evaluateRule(uint8_t index, int16_t value, int16_t rate, time_t timestamp) {
+	const ConfigurationClass::AlarmRule& rule = Configuration.getConfig().alarmRules[index];
+	bool below = rule.type & AL_RULE_BELOW;
+	bool overLimit = below ? value < rule.threshold : value > rule.threshold;
+	bool overRate = rule.rateLimit != 0 &&
+		(below ? rate < -(int16_t)rule.rateLimit : rate > (int16_t)rule.rateLimit);
+
+	if (ruleState[index] == RuleActive) {
+		bool cleared = below ? value >= rule.threshold + rule.hysteresis
+			: value <= rule.threshold - rule.hysteresis;
+		if (cleared && !overRate) {
+			ruleState[index] = RuleArmed;
 		}
-		str++;
+		return;
+	}
+	if (!overLimit && !overRate) {
+		ruleState[index] = RuleArmed;
+		return;
+	}
+	if (ruleState[index] == RuleArmed) {
+		ruleState[index] = RulePending;
+		ruleSince[index] = timestamp;
 	}
+	if (timestamp - ruleSince[index] < rule.duration) return;
+
+	if (overLimit) {
+		raiseAlarm(AL_NO_TRIGGER, timestamp, rule.type, rule.threshold, value);
+	}
+	else {
+		raiseAlarm(AL_NO_TRIGGER, timestamp, rule.type | AL_ALARM_RATE, rule.rateLimit, rate < 0 ? -rate : rate);
+	}
+	ruleState[index] = RuleActive;
 }
 
 void AlarmLogClass::clearAllAlarms() {
+	// Only clears the active alarms. The journal keeps the full history.
 	alarmCount = 0;
+	alarmHead = 0;
 	newAlarm = true;	// True so display knows to clear as well.
 	for (uint8_t i = 0; i < MAX_ALARM_TRIGGERS; i++) {
 		triggered[i] = false;
 	}
+	for (uint8_t i = 0; i < MAX_ALARM_RULES; i++) {
+		ruleState[i] = RuleArmed;
+	}
+	for (uint8_t i = 0; i < AL_RULE_METRICS; i++) {
+		rates[i].refTime = 0;
+		rates[i].rate = 0;
+	}
 }
\ No newline at end of file
@@ -5,19 +5,39 @@
 
 #include "HardwareConfig.h"
 #define MAX_ALARMS 3
-#define MAX_ALARM_TRIGGERS 5
+#define MAX_ALARM_TRIGGERS 2
 #define AL_NO_TRIGGER 0
-#define AL_MAXVOLT_TRIGGER 1
-#define AL_MINVOLT_TRIGGER 2
-#define AL_MAXAMP_TRIGGER 3
-#define AL_BATTERYMETER_TRIGGER 4
+#define AL_BATTERYMETER_TRIGGER 1
+
+// Alarm types. Alarms raised by a rule use the rule type (see Configuration.h)
+// with AL_ALARM_RATE added for a rate of change alarm.
+// Fixed messages use a metric of AL_RULE_DISABLED.
+#define AL_ALARM_RATE 0x40
+#define AL_MSG_NO_METER (1 << 2)
+#define AL_MSG_NO_SD_CARD (2 << 2)
+#define AL_MSG_SD_ERROR (3 << 2)
+// Longest formatted message is "Volt<<2.55 [327.67]"
+#define ALARM_MESSAGE_LEN 20
+// Seconds over which the rate of change for the alarm rules is measured.
+// Long enough that a slow discharge moves the meter by several counts.
+#define AL_RATE_WINDOW 1800
+// Changes of up to this many hundredths over the window count as no change,
+// so a count or two of meter jitter is never a rate.
+#define AL_RATE_DEADBAND 2
 #include <Time.h>
 #include "BatteryMeter.h"
+#include "Configuration.h"
 
+//
+// Alarms are stored unformatted. The message is only
+// formatted by AlarmLogClass::formatAlarm when it is displayed or downloaded.
+//
 class Alarm
 {
 public:
-	char message[18];
+	uint8_t type;		// AL_MSG_xxx or alarm rule type
+	int16_t threshold;	// Hundredths
+	int16_t value;		// Hundredths
 	time_t timestamp;
 };
 
@@ -25,13 +45,36 @@ namespace Scumulator {
 	class AlarmLogTests;
 }
 
+//
+// DESCRIPTION::
+//
+// Alarm rules are stored in the Configuration and evaluated on every measurement.
+// A rule alarms once its condition has held for the rule's duration.
+// It re-arms once the value is back past the threshold by the hysteresis
+// and the rate of change is back under the limit.
+//
 class AlarmLogClass
 {
 	friend class Scumulator::AlarmLogTests;
  protected:
+	 enum { RuleArmed, RulePending, RuleActive };
+
+	 // Reference point for measuring the rate of change of a metric.
+	 struct MetricRate {
+		 int16_t refValue;
+		 time_t refTime;
+		 int16_t rate;		// Hundredths per hour
+	 };
+
 	 byte alarmCount = 0;
+	 byte alarmHead = 0;	// Slot the next alarm is written to. alarms[] is a ring.
 	 bool newAlarm = false;
-	 void substituteString(char* str, const char* val, const char replaceChar) const;
+	 uint8_t ruleState[MAX_ALARM_RULES];
+	 time_t ruleSince[MAX_ALARM_RULES];
+	 MetricRate rates[AL_RULE_METRICS];	// Indexed by metric - 1
+
+	 void updateRate(MetricRate& metric, int16_t value, time_t timestamp);
+	 void evaluateRule(uint8_t index, int16_t value, int16_t rate, time_t timestamp);
 
  public:
 	 AlarmLogClass();
@@ -39,9 +82,14 @@ class AlarmLogClass
 	 void reset() { clearAllAlarms(); }
 	 void newMeasurement(const BatteryMeasurement& value);
 
-	 void raiseAlarm(byte trigger, time_t timestamp, const __FlashStringHelper* msg, const char* limit = 0, const MeterReading *value = 0);
+	 void raiseAlarm(byte trigger, time_t timestamp, uint8_t type, int16_t threshold = 0, int16_t value = 0);
+	 void formatAlarm(char* buf, const Alarm& alarm) const;	// buf must be ALARM_MESSAGE_LEN chars
 	 void clearAllAlarms();
 	 byte getAlarmCount() { return alarmCount;  }
+	 // Returns the index'th most recent alarm. 0 is the newest.
+	 const Alarm& getAlarm(byte index) const {
+		 return alarms[(alarmHead + MAX_ALARMS - 1 - index) % MAX_ALARMS];
+	 }
 	 bool hasNewAlarm(bool resetNew = false) {
 		 if (newAlarm) {
 			 if (resetNew) {
@@ -52,7 +100,7 @@ class AlarmLogClass
 		 return false;
 	 }
 	 Alarm alarms[MAX_ALARMS];
-	 bool triggered[MAX_ALARM_TRIGGERS]; // 2 * volt alarms, 1 * amp alarm, data logger and battery meter
+	 bool triggered[MAX_ALARM_TRIGGERS]; // data logger and battery meter
 };
 
 #endif
@@ -3,17 +3,10 @@
 #include "Configuration.h"
 #include "AlarmLog.h"
 #include "DataLogger.h"
-// :: TODO:: 
-// make these static for the arduino version.
-// same with the data logger errors.
-extern const char ERROR_NO_READING[];
-const char ERROR_NO_READING[] PROGMEM = "no meter";
-
 static const int RESET_DELAY = 3000;  // Show unset values for 3 seconds.
 								// Not configurable. It's just to make
 								// the dispaly look nice on a reset.
 //#define DEMO_MODE
-#define LOG_RAW_DATA
 
 void BatteryMeterClass::init()
 {
@@ -69,6 +62,7 @@ void BatteryMeterClass::process() {
 #ifdef LOG_RAW_DATA
 		DataLogger.logRawData(buf_ptr, nbytes);
 #endif
+		if (rawDataCallback) rawDataCallback(buf_ptr, nbytes);
 		buf_ptr[nbytes] = 0;
 		buf_avail -= nbytes;
 		buf_ptr += nbytes;
@@ -77,7 +71,7 @@ void BatteryMeterClass::process() {
 		unsigned long current_millis = millis();
 		if (current_millis - last_millis > Configuration.getConfig().meterPollFrequency) {
 			if (!readMeter && !AlarmLog.triggered[AL_BATTERYMETER_TRIGGER]) {
-				AlarmLog.raiseAlarm(AL_BATTERYMETER_TRIGGER, now(), (__FlashStringHelper*)ERROR_NO_READING);
+				AlarmLog.raiseAlarm(AL_BATTERYMETER_TRIGGER, now(), AL_MSG_NO_METER);
 			}
 			Serial1.println(F("GVCW"));
 			readMeter = false;
@@ -103,7 +97,9 @@ void BatteryMeterClass::process() {
 		else if (*c == 'W') {
 			*c = 0;
 			incoming_power.parseString(s);
-			nowVal = BatteryMeasurement(BatteryMeasurement::Now, now(), incoming_volts, incoming_amps, incoming_power);
+			uint16_t ms;
+			time_t timestamp = now(ms);
+			nowVal = BatteryMeasurement(BatteryMeasurement::Now, timestamp, ms, incoming_volts, incoming_amps, incoming_power);
 			readMeter = true;
 			incoming_volts = incoming_amps = incoming_power = "";
 			s = c + 1;
@@ -147,6 +143,10 @@ void BatteryMeterClass::measurementHandler(updateEventHandler handler) {
 	updateCallback = handler;
 }
 
+void BatteryMeterClass::rawDataHandler(rawDataEventHandler handler) {
+	rawDataCallback = handler;
+}
+
 void BatteryMeterClass::updated() {
 	if (updateCallback) updateCallback(nowVal);
 }
@@ -10,6 +10,7 @@ public:
 
 	MeasurementType type;
 	time_t timestamp;
+	uint16_t timestampMs;	// Milliseconds past timestamp
 	MeterReading volts;
 	MeterReading amps;
 	MeterReading power;
@@ -19,10 +20,10 @@ public:
 		is_set = false;
 	}
 
-	BatteryMeasurement(MeasurementType typeVal, time_t timestampVal, MeterReading& voltVal, 
+	BatteryMeasurement(MeasurementType typeVal, time_t timestampVal, uint16_t timestampMsVal, MeterReading& voltVal, 
 		MeterReading& ampVal, MeterReading& powerVal) :
 		type(typeVal), volts(voltVal), amps(ampVal), power(powerVal), 
-		timestamp(timestampVal), is_set(true) {
+		timestamp(timestampVal), timestampMs(timestampMsVal), is_set(true) {
 	}
 };
 
@@ -31,14 +32,16 @@ class BatteryMeterClass
 {
 public:
 	typedef void(*updateEventHandler)(const BatteryMeasurement&);
+	typedef void(*rawDataEventHandler)(const char* data, uint8_t length);
 
-	BatteryMeterClass() { updateCallback = 0; }
+	BatteryMeterClass() { updateCallback = 0; rawDataCallback = 0; }
 
 	void init();
 	void reset();
 	void process();
 
 	void measurementHandler(updateEventHandler handler);
+	void rawDataHandler(rawDataEventHandler handler);
 
 	// Note that min/max timestamp only refers to Volts, not amps.
 	BatteryMeasurement minVal;
@@ -47,6 +50,7 @@ public:
 
 protected:
 	updateEventHandler updateCallback;
+	rawDataEventHandler rawDataCallback;
 	unsigned long last_millis;
 
 	void updateMaxMin(BatteryMeasurement& measure);
@@ -1,32 +1,150 @@
-// 
-// 
-//
-#ifndef ARDUINO
-// Only need to set this base configuration data once
-// as it is stored in EEPROM.
-// Need to always set it for WIN32
-#define SET_INITIAL_DATA
-#endif
+//
+//
+//
 #include "Configuration.h"
+
+// Used when there is no valid configuration in EEPROM,
+// and for fields added since an older configuration was saved.
+static const ConfigurationClass::Config defaultConfig PROGMEM = {
+	30000,	// screenSaverTimeout
+	5000,	// meterPollFrequency
+	{
+		// Max volts, min volts (ignoring cranking dips), max amps.
+		{ AL_RULE_VOLTS, 1500, 20, 0, 0 },
+		{ AL_RULE_VOLTS | AL_RULE_BELOW, 1000, 20, 10, 0 },
+		{ AL_RULE_AMPS, 1000, 50, 0, 0 },
+		{ AL_RULE_DISABLED, 0, 0, 0, 0 }
+	},
+	5000,	// loggingFrequency
+	0		// clockSyncTime
+};
+
 void ConfigurationClass::init()
 {
 	loadConfig();
-#ifdef SET_INITIAL_DATA
-	if (configuration.screenSaverTimeout == 0) {
-		// set some defaults. These aren't saved in EEPROM
-		configuration.screenSaverTimeout = 30000;
-		configuration.meterPollFrequency = 5000;
-		strlcpy(configuration.maxVolts, "15", 3);
-		strlcpy(configuration.minVolts, "10", 3);
-		strlcpy(configuration.maxAmps, "10", 3);
-		configuration.loggingFrequency = configuration.meterPollFrequency;
-	}
-#endif
 }
+
+//
+// Loads the valid slot with the latest sequence in a single pass over the journal.
+// The sequence wraps, but there are far fewer slots than sequence numbers so
+// a signed difference still orders them.
+//
 void ConfigurationClass::loadConfig() {
-	eeprom_read_block(&configuration, 0, sizeof(configuration));
+	Blob blob;
+	bool found = false;
+	for (uint8_t i = 0; i < CONFIG_SLOTS; i++) {
+		if (readSlot(i, blob) &&
+			(!found || (int8_t)(blob.header.sequence - sequence) > 0)) {
+			configuration = blob.config;
+			sequence = blob.header.sequence;
+			slot = i;
+			found = true;
+		}
+	}
+	if (!found) {
+		memcpy_P(&configuration, &defaultConfig, sizeof(configuration));
+		sequence = 0;
+		slot = 0;
+	}
 }
 
+//
+// Saves to the slot after the last save, so the last save
+// is still intact if this write is interrupted.
+//
 void ConfigurationClass::saveConfig() {
-	eeprom_update_block(&configuration, 0, sizeof(configuration));
+	Slot record;
+	sequence++;
+	slot = (slot + 1) % CONFIG_SLOTS;
+	record.writes = getSlotWrites(slot) + 1;
+	toBlob(record.blob);
+	eeprom_update_block(&record, (void*)slotAddress(slot), sizeof(record));
+}
+
+bool ConfigurationClass::readSlot(uint8_t index, Blob& blob) {
+	eeprom_read_block(&blob, (void*)(slotAddress(index) + offsetof(Slot, blob)), sizeof(blob));
+	return migrate(blob);
+}
+
+uint16_t ConfigurationClass::getSlotWrites(uint8_t index) {
+	uint16_t writes;
+	eeprom_read_block(&writes, (void*)slotAddress(index), sizeof(writes));
+	// Erased EEPROM reads as 0xFF
+	return writes == 0xFFFF ? 0 : writes;
+}
+
+void ConfigurationClass::toBlob(Blob& blob) {
+	blob.header.version = CONFIG_VERSION;
+	blob.header.size = sizeof(Config);
+	blob.header.sequence = sequence;
+	blob.config = configuration;
+	blob.header.crc = blobCrc(blob);
+}
+
+//
+// Replaces the configuration with one from the host and saves it.
+// Nothing is changed unless the blob is valid.
+//
+bool ConfigurationClass::fromBlob(Blob& blob) {
+	if (!migrate(blob) || !isValid(blob.config)) {
+		return false;
+	}
+	// Not set by the host
+	blob.config.clockSyncTime = configuration.clockSyncTime;
+	configuration = blob.config;
+	saveConfig();
+	return true;
+}
+
+uint16_t ConfigurationClass::blobCrc(const Blob& blob) {
+	uint16_t crc = crc16(0xFFFF, &blob.header, offsetof(Header, crc));
+	return crc16(crc, &blob.config, blob.header.size);
+}
+
+//
+// Checks the header and crc, and brings an older version up to date.
+// Fields that the older version doesn't have are set to their defaults.
+//
+bool ConfigurationClass::migrate(Blob& blob) {
+	if (blob.header.version == 0 ||
+		blob.header.version > CONFIG_VERSION ||
+		blob.header.size > sizeof(Config) ||
+		blob.header.crc != blobCrc(blob)) {
+		return false;
+	}
+	if (blob.header.version < 2) {
+		// Rate limits were per minute.
+		for (uint8_t i = 0; i < MAX_ALARM_RULES; i++) {
+			uint16_t rate = blob.config.alarmRules[i].rateLimit * 60U;
+			blob.config.alarmRules[i].rateLimit = rate > 255 ? 255 : rate;
+		}
+		blob.header.version = CONFIG_VERSION;
+	}
+	if (blob.header.size < sizeof(Config)) {
+		memcpy_P((uint8_t*)&blob.config + blob.header.size,
+			(const uint8_t*)&defaultConfig + blob.header.size,
+			sizeof(Config) - blob.header.size);
+		blob.header.version = CONFIG_VERSION;
+		blob.header.size = sizeof(Config);
+	}
+	return true;
+}
+
+bool ConfigurationClass::isValid(const Config& config) {
+	if (config.screenSaverTimeout < 1000UL || config.screenSaverTimeout > 86400000UL ||
+		config.meterPollFrequency < 500UL || config.meterPollFrequency > 3600000UL ||
+		config.loggingFrequency > 86400000UL) {
+		return false;
+	}
+	for (uint8_t i = 0; i < MAX_ALARM_RULES; i++) {
+		if (!isValidRule(config.alarmRules[i])) {
+			return false;
+		}
+	}
+	return true;
+}
+
+bool ConfigurationClass::isValidRule(const AlarmRule& rule) {
+	return (rule.type & ~(AL_RULE_METRIC_MASK | AL_RULE_BELOW)) == 0 &&
+		(rule.type & AL_RULE_METRIC_MASK) <= AL_RULE_METRICS;
 }
@@ -5,34 +5,106 @@
 
 #include "HardwareConfig.h"
 
+#define MAX_ALARM_RULES 4
+
+// Alarm rule types. The low bits select the metric the rule checks.
+// AL_RULE_BELOW makes it a "less than" rule, otherwise it is "greater than".
+#define AL_RULE_DISABLED 0
+#define AL_RULE_VOLTS 1
+#define AL_RULE_AMPS 2
+#define AL_RULE_METRIC_MASK 0x03
+#define AL_RULE_METRICS 2
+#define AL_RULE_BELOW 0x80
+
+// Version of the Config layout. Fields are only ever added to the end of
+// Config, so older versions are migrated by filling the new fields with defaults.
+// Version 2 changed the rule rate limit from per minute to per hour.
+#define CONFIG_VERSION 2
+// EEPROM used for the configuration journal. All of it on an ATmega328.
+#define CONFIG_EEPROM_SIZE 1024
+// Number of records in the configuration journal.
+#define CONFIG_SLOTS (CONFIG_EEPROM_SIZE / sizeof(ConfigurationClass::Slot))
+
 // 
 // DESCRIPTION::
 // 
 // Configuration stored in EEPROM
 // and updated from the SerialPort
 //
+// The configuration is stored and transferred as a Blob, a versioned header
+// with a CRC followed by the Config. The layout is packed, and only uses
+// fixed width fields, so it is the same on the Arduino, the WIN32 build and
+// the host. time_t is 8 bytes on WIN32, so times are held as uint32_t.
+//
+// EEPROM is a journal of Slots. Each save goes to the slot after the last one,
+// spreading the wear over the whole EEPROM, and leaving the previous
+// save intact if the write is interrupted. Each slot counts its writes
+// so the remaining EEPROM life can be estimated.
+//
+#pragma pack(push, 1)
 class ConfigurationClass
 {
 public:
+	// All values are in hundredths, e.g. a threshold of 1450 is 14.50V
+	struct AlarmRule {
+		uint8_t type;		// AL_RULE_xxx
+		int16_t threshold;
+		uint8_t hysteresis;	// How far back past the threshold before the rule re-arms
+		uint8_t duration;	// Seconds the condition must hold before alarming
+		uint8_t rateLimit;	// Max change per hour towards the threshold. 0 to disable.
+	};
+
 	struct Config {
-		unsigned long screenSaverTimeout;
-		unsigned long meterPollFrequency;
-		char maxVolts[3];
-		char minVolts[3];
-		char maxAmps[3];
-		unsigned long loggingFrequency;
+		uint32_t screenSaverTimeout;
+		uint32_t meterPollFrequency;
+		AlarmRule alarmRules[MAX_ALARM_RULES];
+		uint32_t loggingFrequency;
+		uint32_t clockSyncTime;	// When the host last set the clock to the ms. 0 if unknown.
+	};
+
+	struct Header {
+		uint8_t version;	// CONFIG_VERSION of the config that follows
+		uint8_t size;		// sizeof(Config) for that version
+		uint8_t sequence;	// Incremented on each save to find the latest EEPROM slot
+		uint16_t crc;		// crc16 of the rest of the header and the config
+	};
+
+	struct Blob {
+		Header header;
+		Config config;
+	};
+
+	struct Slot {
+		uint16_t writes;	// Times this slot has been written. Not covered by the crc.
+		Blob blob;
 	};
 
 	void init();
 	Config& getConfig() { return configuration;  }
 	void saveConfig();
 
+	void toBlob(Blob& blob);
+	bool fromBlob(Blob& blob);
+
+	static bool isValid(const Config& config);
+	static bool isValidRule(const AlarmRule& rule);
+
+	static uint8_t getSlotCount() { return CONFIG_SLOTS; }
+	static uint16_t getSlotWrites(uint8_t index);
+
 protected:
 	void loadConfig();
+	static uint16_t blobCrc(const Blob& blob);
+	static bool migrate(Blob& blob);
+	bool readSlot(uint8_t slot, Blob& blob);
+	static uint16_t slotAddress(uint8_t slot) { return slot * sizeof(Slot); }
 
 private:
 	Config configuration;
+	uint8_t sequence;	// Sequence of the last save
+	uint8_t slot;		// EEPROM slot of the last save
 };
+#pragma pack(pop)
 
 
 #endif
@@ -1,105 +1,242 @@
 #include "DataLogger.h"
-#include <DS3232RTC.h>
 #include <Time.h>
 #include "AlarmLog.h"
 #include "Configuration.h"
-// Error messages
-extern const char ERROR_NO_SD_CARD[];
-const char ERROR_NO_SD_CARD[] PROGMEM = "Insert SD"; 
-static const char ERROR_NO_FILE[] PROGMEM = "SD r/w Error"; 
-static const byte FILENAME_YEAR_START = 0;
-char DataLoggerClass::loggingFilename[] = "yyyymm.csv";	// Modifyable.
-
-#define ALTERNATIVE_LOGGER
+// Log files are /LOG/yyyy/mm.csv
+char DataLoggerClass::loggingFilename[] = "mm.csv";	// Modifyable.
+const char DataLoggerClass::logDirName[] = "/LOG";
+const char DataLoggerClass::alarmFilename[] = "alarms.log";
+const char DataLoggerClass::catalogFilename[] = "/LOG/months.cat";
+const char DataLoggerClass::rawFilename[] = "rawring.log";
 
 DataLoggerClass::~DataLoggerClass() {
 }
 
 void DataLoggerClass::init()
 {
-	rtcInit();
 	clearError();
+	alarmJournal.count = 0;
 	if (!is_initialised) {
 		if (!SD.begin(cs_pin, SPI_FULL_SPEED)) {
-			setError(ERROR_NO_SD_CARD);
+			setError(AL_MSG_NO_SD_CARD);
 			return;
 		}
 	}
 	is_initialised = true;
+	// Directory handles don't survive re-initialising the card.
+	logYearDir.close();
+	logYear = 0;
+	logMonthLength = 0;
+
+	// Cache the journal header so the display can page
+	// through the alarms without re-reading it.
+	openAlarmJournal();
+	log_file.close();
+
+	// A card last written without the catalog, or by older firmware
+	// that kept the log files in the root.
+	File catalog;
+	CatalogHeader header;
+	if (!openCatalog(catalog, header)) {
+		catalog.close();
+		if (!rebuildCatalog() || !openCatalog(catalog, header)) {
+			header.count = 0;
+		}
+	}
+	// The newest month is the only one that can have been cut short.
+	MonthEntry entry;
+	bool haveEntry = header.count > 0 && readMonthEntry(catalog, header.count - 1, entry);
+	catalog.close();
+	if (haveEntry) {
+		recoverLogFile(entry);
+	}
+#ifdef LOG_RAW_DATA
+	openRawLog();
+#endif
 }
 
-void DataLoggerClass::rtcInit() {
-	// Turn off unneeded outputs to save battery
-	RTC.set33kHzOutput(false);
-	RTC.setSQIMode(sqiModeNone);
+//
+// Repairs the newest log file after power failed during a write.
+// A line cut short is removed, and clusters that were allocated by a
+// write that didn't reach the directory entry are freed.
+//
+void DataLoggerClass::recoverLogFile(const MonthEntry& entry) {
+	if (!openYearDir(entry.month / 100) ||
+		!openMonthFile(entry.month % 100, entry.dirIndex, O_RDWR)) {
+		log_file.close();
+		return;
+	}
+	// Cut back to the end of the last whole line. A torn line is normally
+	// shorter than LOG_LINE_SIZE, but blocks that were never written can
+	// leave more, so keep going back until a line end or the start of the file.
+	uint32_t size = log_file.fileSize();
+	uint32_t end = size;
+	TMPBUF_ACQUIRE;
+	while (end > 0) {
+		uint8_t n = end < sizeof(TMPBUF) ? end : sizeof(TMPBUF);
+		if (!log_file.seekSet(end - n) || log_file.read(TMPBUF, n) != n) {
+			end = size;
+			break;
+		}
+		while (n > 0 && TMPBUF[n - 1] != '\n') {
+			n--;
+			end--;
+		}
+		if (n > 0) {
+			break;
+		}
+	}
+	TMPBUF_RELEASE;
+	bool extraClusters = false;
+#ifdef ARDUINO
+	uint32_t clusterBytes = (uint32_t)SD.blocksPerCluster() * 512;
+	uint32_t needed = (end + clusterBytes - 1) / clusterBytes;
+	uint32_t chain = chainLength(log_file.firstCluster());
+	extraClusters = chain > needed;
+#endif
+	if ((end < size || extraClusters) && log_file.truncate(end)) {
+		tornBytes += size - end;
+#ifdef ARDUINO
+		// Counted from the chain that is left, as truncate may keep more than needed.
+		uint32_t kept = chainLength(log_file.firstCluster());
+		freedClusters += chain > kept ? chain - kept : 0;
+#endif
+	}
+	log_file.close();
+}
 
-	// set the time sync off the RTC.
-	setSyncProvider(RTC.get);
+#ifdef ARDUINO
+// Counts the clusters in a chain. Stops after as many clusters
+// as the volume has, in case the chain is corrupt and loops.
+uint32_t DataLoggerClass::chainLength(uint32_t cluster) {
+	uint32_t length = 0;
+	while (cluster && length < SD.clusterCount()) {
+		length++;
+		// Public access to the FAT
+		if (SD.dbgFat(cluster, &cluster) != 1) {
+			break;
+		}
+	}
+	return length;
 }
+#endif
 
-void DataLoggerClass::setLogFileName(char* fn, uint16_t year, uint8_t month)
-{
-	fn[FILENAME_YEAR_START + 0] = (year / 1000) + '0';
-	fn[FILENAME_YEAR_START + 1] = ((year / 100) % 10) + '0';
-	fn[FILENAME_YEAR_START + 2] = ((year / 10) % 10) + '0';
-	fn[FILENAME_YEAR_START + 3] = (year % 10) + '0';
-	fn[FILENAME_YEAR_START + 4] = (month / 10) + '0';
-	fn[FILENAME_YEAR_START + 5] = (month % 10) + '0';
+// Writes value into s as digits characters, zero padded.
+void DataLoggerClass::setDigits(char* s, uint16_t value, uint8_t digits) {
+	while (digits > 0) {
+		s[--digits] = (value % 10) + '0';
+		value /= 10;
+	}
 }
 
-void DataLoggerClass::setLogFileName(uint16_t year, uint8_t month) {
-	setLogFileName(loggingFilename, year, month);
+// Returns the number that a short file name starts with, or 0 if it
+// isn't digits digits followed by ext. getSFN gives names that SdFat
+// created in lower case, and names from a PC in upper case.
+uint32_t DataLoggerClass::parseLogName(const char* sfn, uint8_t digits, const char* ext) {
+	uint32_t value = 0;
+	for (uint8_t i = 0; i < digits; i++) {
+		if (sfn[i] < '0' || sfn[i] > '9') {
+			return 0;
+		}
+		value = value * 10 + sfn[i] - '0';
+	}
+	return strcasecmp(&sfn[digits], ext) == 0 ? value : 0;
 }
 
-// only call if initialised
-// creates a log file for each year/month
-void DataLoggerClass::initLogFile(time_t timestamp) {
-	initLogFile(year(timestamp), month(timestamp));
+//
+// Opens /LOG/yyyy into logYearDir, creating it if need be.
+// It is kept open so that the month files can be opened in it
+// without searching the root.
+//
+bool DataLoggerClass::openYearDir(uint16_t year) {
+	if (year == logYear && logYearDir.isOpen()) {
+		return true;
+	}
+	logYearDir.close();
+	logYear = 0;
+	// The log file's directory entry is only valid in its own year.
+	logMonthLength = 0;
+
+	char path[] = "/LOG/yyyy";
+	setDigits(&path[sizeof(logDirName)], year, 4);
+	if (!logYearDir.open(path, O_READ) &&
+		!(SD.mkdir(path) && logYearDir.open(path, O_READ))) {
+		return false;
+	}
+	logYear = year;
+	return true;
 }
 
-void DataLoggerClass::initLogFile(uint16_t year, uint8_t month) {
-	if (logYear == year && logMonth == month){
-		// log file already open
-		return;
+//
+// Opens a month's log file in logYearDir by its directory entry, so
+// there is no name search. Falls back to the name if the entry no longer
+// holds the file, e.g. the card has been tidied up on a PC.
+//
+bool DataLoggerClass::openMonthFile(uint8_t month, uint16_t dirIndex, uint8_t oflag) {
+#ifdef ARDUINO
+	char sfn[13]; // short file name
+	if (log_file.open(&logYearDir, dirIndex, oflag & ~O_CREAT)) {
+		if (log_file.getSFN(sfn) && parseLogName(sfn, 2, ".CSV") == month) {
+			return true;
+		}
+		log_file.close();
+	}
+#endif
+	setDigits(loggingFilename, month, 2);
+	return log_file.open(&logYearDir, loggingFilename, oflag);
+}
+
+// only call if initialised
+// creates a log file for each year/month
+// Returns false if the log file can't be opened.
+bool DataLoggerClass::initLogFile(time_t timestamp) {
+	// Single compare against the cached month range. The calendar is only
+	// broken down when the month rolls over.
+	if ((uint32_t)(timestamp - logMonthStart) < logMonthLength) {
+		// Reopen by its directory entry if another operation closed it.
+		return log_file.isOpen() ||
+			openMonthFile(timeElements(logMonthStart).Month, logFileIndex, O_RDWR | O_CREAT | O_AT_END);
 	}
 	else {
+		const tmElements_t& tm = timeElements(timestamp);
 		log_file.close();
-		setLogFileName(year, month);
-		
-		if (!log_file.open(loggingFilename, O_RDWR | O_CREAT | O_AT_END)) {
-			checkWriteError(-1);
-			return;
+		logMonthLength = 0;
+		uint16_t year = tmYearToCalendar(tm.Year);
+		uint8_t month = tm.Month;
+
+		// At most a dozen entries to search, however long the history.
+		setDigits(loggingFilename, month, 2);
+		if (!openYearDir(year) ||
+			!log_file.open(&logYearDir, loggingFilename, O_RDWR | O_CREAT | O_AT_END)) {
+			return false;
+		}
+#ifdef ARDUINO
+		logFileIndex = log_file.dirIndex();
+#endif
+		if (!catalogLogFile(year * 100UL + month)) {
+			return false;
 		}
-		logYear = year;
-		logMonth = month;
+		logMonthStart = monthStart(timestamp);
+		logMonthLength = nextMonthStart(timestamp) - logMonthStart;
+		return true;
 	}
 }
 
 
-void DataLoggerClass::setTime(uint16_t year, uint8_t month, uint8_t day, uint8_t hour, uint8_t minute, uint8_t second) {
-	tmElements_t tm;
-	tm.Year = CalendarYrToTm(year);
-	tm.Month = month;
-	tm.Day = day;
-	tm.Hour = hour;
-	tm.Minute = minute;
-	tm.Second = second;
-	RTC.write(tm);
-	setSyncProvider(RTC.get);
-}
-
-void DataLoggerClass::setError(const char* msg) {
-	AlarmLog.raiseAlarm(AL_NO_TRIGGER, now(), (__FlashStringHelper*)msg);
+void DataLoggerClass::setError(uint8_t alarmType) {
+	AlarmLog.raiseAlarm(AL_NO_TRIGGER, now(), alarmType);
 }
 
 void DataLoggerClass::clearError() {
 	has_write_error = false;
 }
 
+// Closes log_file for another operation. The log file is reopened
+// by its directory entry when the next line is written.
 void DataLoggerClass::resetLog() {
+	// Everything else that uses log_file blocks anyway.
+	finishWrite();
 	log_file.close();
-	logYear = -1;
-	logMonth = -1;
 }
 
 void DataLoggerClass::reset() {
@@ -115,13 +252,18 @@ void DataLoggerClass::checkWriteError(int8_t val) {
 		if (!has_write_error) {
 			// Don't keep logging write_errors
 			has_write_error = true;
-			setError(ERROR_NO_FILE);
+			setError(AL_MSG_SD_ERROR);
 		}
 	}
 	// Don't reset here as not all functions consistently return -1 on write errors
 	// needs ot be reset to log new errors.
 }
 
+//
+// Queues the measurement to be written to the log file by poll(), so the caller
+// never waits for the SD card. Only blocks if the last line is still being
+// written, which takes far less than the logging interval.
+//
 void DataLoggerClass::newMeasurement(const BatteryMeasurement& value) {
 	
 	if (!value.is_set) return;
@@ -131,40 +273,139 @@ void DataLoggerClass::newMeasurement(const BatteryMeasurement& value) {
 		currentMillis - lastMillis >= Configuration.getConfig().loggingFrequency) {
 
 		lastMillis = currentMillis;
+		finishWrite();
+		formatLine(value);
+		startWrite(value.timestamp, logWriteComplete);
+	}
+}
 
-		initLogFile(value.timestamp);
-#ifndef ALTERNATIVE_LOGGER
-		// format is timestamp,volts,amps,power
-		//           1         2         3 
-		// 01234567890123456789012345678901234
-		// TTTTTTTTTT,VV.VV,AA.AA,PP.PP\0
-		TMPBUF_ACQUIRE;
-		ultoa(value.timestamp, TMPBUF, 10);
-		TMPBUF[10] = ',';
-		strlcpy(&TMPBUF[11], value.volts.toString(), METER_READING_STRLEN);
-		TMPBUF[16] = ',';
-		strlcpy(&TMPBUF[17], value.amps.toString(), METER_READING_STRLEN);
-		TMPBUF[22] = ',';
-		strlcpy(&TMPBUF[23], value.power.toString(), METER_READING_STRLEN);
-		// strlcpy will null terminate.
-		checkWriteError(log_file.println(TMPBUF));
-		TMPBUF_RELEASE;
-#else
-	// NOTE the code below is smaller.
-	// so keeping it in case we need to shrink ~100 bytes.
-		checkWriteError(log_file.print(value.timestamp));
-		checkWriteError(log_file.print(','));
-		checkWriteError(log_file.print(value.volts.toString()));
-		checkWriteError(log_file.print(','));
-		checkWriteError(log_file.print(value.amps.toString()));
-		checkWriteError(log_file.print(','));
-		checkWriteError(log_file.println(value.power.toString()));
+// format is timestamp,volts,amps,power,milliseconds, framed as a record
+// e.g. $1420070400,12.34,-1.23,-15.18,250*210622
+void DataLoggerClass::formatLine(const BatteryMeasurement& value) {
+	writeLine[0] = LOG_RECORD_START;
+	ultoa(value.timestamp, &writeLine[1], 10);
+	strcat(writeLine, ",");
+	strcat(writeLine, value.volts.toString());
+	strcat(writeLine, ",");
+	strcat(writeLine, value.amps.toString());
+	strcat(writeLine, ",");
+	strcat(writeLine, value.power.toString());
+	strcat(writeLine, ",");
+	ultoa(value.timestampMs, writeLine + strlen(writeLine), 10);
+
+	uint8_t length = strlen(writeLine) - 1;
+	char* check = &writeLine[length + 1];
+	check[0] = LOG_RECORD_CHECK;
+	setHex(&check[1], length, 2);
+	setHex(&check[3], crc16(0xFFFF, &writeLine[1], length), 4);
+	strcpy(&check[7], "\r\n");
+	writeLength = length + 10;
+}
+
+// Writes value into s as digits hex characters.
+void DataLoggerClass::setHex(char* s, uint16_t value, uint8_t digits) {
+	while (digits > 0) {
+		uint8_t nibble = value & 0xF;
+		s[--digits] = nibble < 10 ? nibble + '0' : nibble - 10 + 'A';
+		value >>= 4;
+	}
+}
+
+// Returns the value of digits hex characters, or -1 if they aren't hex.
+int32_t DataLoggerClass::parseHex(const char* s, uint8_t digits) {
+	int32_t value = 0;
+	for (uint8_t i = 0; i < digits; i++) {
+		char c = s[i];
+		value <<= 4;
+		if (c >= '0' && c <= '9') value |= c - '0';
+		else if (c >= 'A' && c <= 'F') value |= c - 'A' + 10;
+		else return -1;
+	}
+	return value;
+}
+
+// Starts appending writeLine to the log file for timestamp.
+// handler is called from poll() once the card has finished programming it.
+void DataLoggerClass::startWrite(time_t timestamp, writeCompleteHandler handler) {
+	writeTimestamp = timestamp;
+	writeHandler = handler;
+	writeOk = false;
+	writeState = WriteAppend;
+	writeStepStart = millis();
+}
+
+//
+// Advances the write in progress by one step, once the card has finished
+// programming the last step. Call from loop().
+// Each step writes one block (more when a cluster is allocated) and then
+// returns, as the card takes up to hundreds of ms to program a block.
+// The data and directory blocks are written in separate steps, as syncing
+// the file reads the directory block, which would wait for the data block.
+//
+void DataLoggerClass::poll() {
+#ifdef LOG_RAW_DATA
+	// Copy the raw capture to the file between log writes.
+	if (writeState == WriteIdle && rawLength >= RAW_LOG_BUFFER_SIZE / 2 && !cardBusy()) {
+		flushRawLog();
+	}
+#endif
+	if (writeState == WriteIdle) {
+		return;
+	}
+	if (cardBusy()) {
+		if (millis() - writeStepStart < LOG_WRITE_TIMEOUT) {
+			return;
+		}
+		writeOk = false;
+		writeState = WriteComplete;
+	}
+	writeStepStart = millis();
+	switch (writeState) {
+	case WriteAppend:
+		writeOk = initLogFile(writeTimestamp) &&
+			log_file.write(writeLine, writeLength) == writeLength;
+		writeState = writeOk ? WriteFlushData : WriteComplete;
+		break;
+	case WriteFlushData:
+#ifdef ARDUINO
+		writeOk = SD.cacheFlush();
 #endif
+		writeState = writeOk ? WriteFlushDir : WriteComplete;
+		break;
+	case WriteFlushDir:
+		writeOk = log_file.sync();
+		writeState = WriteComplete;
+		break;
+	default:
+		// Idle before the handler is called, as it may log an alarm.
+		writeState = WriteIdle;
+		if (writeHandler) {
+			writeHandler(writeOk);
+		}
+		break;
+	}
+}
 
-		log_file.flush();
+// Completes the write in progress, for operations that need log_file.
+void DataLoggerClass::finishWrite() {
+	while (writeState != WriteIdle) {
+		poll();
 	}
 }
 
+// The card holds MISO low while it is programming.
+bool DataLoggerClass::cardBusy() {
+#ifdef ARDUINO
+	return SD.card()->isBusy();
+#else
+	return false;
+#endif
+}
+
+void DataLoggerClass::logWriteComplete(bool ok) {
+	DataLogger.checkWriteError(ok ? 0 : -1);
+}
+
 //
 // Note that this requires a newline at the end of the line
 // to ensure the last value is captured correctly.
@@ -195,43 +436,262 @@ char* DataLoggerClass::getCsvString(char* buf, int startPos, int& nextPos) {
 void DataLoggerClass::dumpTo(uint32_t startDate, uint32_t endDate, updateEventHandler handler) {
 	if((startDate == 0) && (endDate == 0)) {
 		// open the file for the current year/month
-		initLogFile(now());
+		finishWrite();
+		if (!initLogFile(now())) {
+			checkWriteError(-1);
+		}
 		log_file.seekSet(0);
 		dumpLogFile(handler);
 	}
 	else {
 
-		// Set up two filenames a start and an end one.
-		// then do a string compare on the files in the directory
-		// to see if file is between the two.
-		char startFileName[sizeof(loggingFilename)];
-		char endFileName[sizeof(loggingFilename)];
-		strlcpy(startFileName, loggingFilename, sizeof(startFileName));
-		strlcpy(endFileName, loggingFilename, sizeof(endFileName));
-		setLogFileName(startFileName, startDate / 100, startDate % 100);
-		setLogFileName(endFileName, endDate / 100, endDate % 100);
-
-		// There's no guarantee files will be sent in order, but it's
-		// pretty likely as files are created in order
-		log_file.close();
-		SD.chdir(true);	// The chdir forces a reset for the openNext
-
-		while (log_file.openNext(SD.vwd())) {
-			if (log_file.isFile()) {
-				char sfn[13]; // short file name
-				// Note that dumpLogFile uses TMPBUF
-				// so cannot be used for sfn
-				log_file.getSFN(sfn);
-				if (strcmp(sfn, startFileName) >= 0 &&
-					strcmp(sfn, endFileName) <= 0) {
+		// The catalog is sorted, so the files are sent in order
+		// and the search can stop after the end date.
+		resetLog();
+		File catalog;
+		CatalogHeader header;
+		MonthEntry entry;
+		bool haveCatalog = openCatalog(catalog, header);
+		if (!haveCatalog) {
+			// Removed after a failed write, or never made on this card.
+			catalog.close();
+			haveCatalog = rebuildCatalog() && openCatalog(catalog, header);
+		}
+		if (haveCatalog) {
+			for (uint16_t i = 0; i < header.count; i++) {
+				if (!readMonthEntry(catalog, i, entry) || entry.month > endDate) {
+					break;
+				}
+				if (entry.month >= startDate &&
+					openYearDir(entry.month / 100) &&
+					openMonthFile(entry.month % 100, entry.dirIndex, O_READ)) {
 					dumpLogFile(handler);
+					log_file.close();
 				}
 			}
 		}
+		catalog.close();
 	}
 	resetLog();
 }
 
+uint32_t DataLoggerClass::catalogRecordPos(uint16_t record) {
+	return sizeof(CatalogHeader) + (uint32_t)record * sizeof(MonthEntry);
+}
+
+//
+// Opens the month catalog and loads the header.
+// Returns false if there is no catalog or it isn't recognised.
+// It is never created here, as an empty catalog would hide every month.
+// Caller must close catalog.
+//
+bool DataLoggerClass::openCatalog(File& catalog, CatalogHeader& header) {
+	return catalog.open(catalogFilename, O_RDWR) &&
+		catalog.read(&header, sizeof(header)) == sizeof(header) &&
+		header.recordSize == sizeof(MonthEntry) &&
+		catalog.fileSize() >= catalogRecordPos(header.count);
+}
+
+bool DataLoggerClass::readMonthEntry(File& catalog, uint16_t record, MonthEntry& entry) {
+	return catalog.seekSet(catalogRecordPos(record)) &&
+		catalog.read(&entry, sizeof(entry)) == sizeof(entry);
+}
+
+//
+// Adds a month to the catalog, keeping it sorted. Months are normally
+// created in order so the entries are searched from the end, and only
+// have to be moved up if the clock has been set back.
+// The entry is replaced if the month is already in the catalog.
+//
+bool DataLoggerClass::addToCatalog(File& catalog, CatalogHeader& header, const MonthEntry& entry) {
+	MonthEntry last;
+	uint16_t i = header.count;
+	while (i > 0) {
+		if (!readMonthEntry(catalog, i - 1, last)) {
+			return false;
+		}
+		if (last.month == entry.month) {
+			if (last.dirIndex == entry.dirIndex) {
+				return true;
+			}
+			i--;
+			break;
+		}
+		if (last.month < entry.month) {
+			break;
+		}
+		if (!catalog.seekSet(catalogRecordPos(i)) ||
+			catalog.write(&last, sizeof(last)) != sizeof(last)) {
+			return false;
+		}
+		i--;
+	}
+	if (i == header.count || last.month != entry.month) {
+		header.count++;
+	}
+	return catalog.seekSet(catalogRecordPos(i)) &&
+		catalog.write(&entry, sizeof(entry)) == sizeof(entry) &&
+		catalog.seekSet(0) &&
+		catalog.write(&header, sizeof(header)) == sizeof(header);
+}
+
+//
+// Adds the log file that has just been opened to the catalog.
+// If the catalog is missing or can't be updated it is rebuilt, which picks up
+// this file too. The rebuild scans with log_file, so the log file is opened
+// again afterwards. Returns false if it can't be.
+// This is part of a log write, so a failure can't raise an alarm here. A catalog
+// that can't be rebuilt is removed, to be tried again by the next dump or init.
+//
+bool DataLoggerClass::catalogLogFile(uint32_t month) {
+	MonthEntry entry;
+	entry.month = month;
+	entry.dirIndex = logFileIndex;
+	File catalog;
+	CatalogHeader header;
+	bool added = openCatalog(catalog, header) &&
+		addToCatalog(catalog, header, entry);
+	catalog.close();
+	if (added) {
+		return true;
+	}
+	log_file.close();
+	if (!rebuildCatalog()) {
+		SD.remove(catalogFilename);
+	}
+	return openYearDir(month / 100) &&
+		log_file.open(&logYearDir, loggingFilename, O_RDWR | O_CREAT | O_AT_END);
+}
+
+//
+// Rebuilds the catalog from the year directories in /LOG.
+// Only needed once for a card, so dumps never scan the directories.
+//
+bool DataLoggerClass::rebuildCatalog() {
+	migrateRootLogs();
+	logYearDir.close();
+	logYear = 0;
+	logMonthLength = 0;
+
+	File catalog;
+	CatalogHeader header;
+	header.recordSize = sizeof(MonthEntry);
+	header.count = 0;
+	bool ok = (SD.exists(logDirName) || SD.mkdir(logDirName)) &&
+		catalog.open(catalogFilename, O_RDWR | O_CREAT | O_TRUNC) &&
+		catalog.write(&header, sizeof(header)) == sizeof(header);
+
+	File logDir;
+	char sfn[13]; // short file name
+	ok = ok && logDir.open(logDirName, O_READ);
+	while (ok && logYearDir.openNext(&logDir)) {
+		uint16_t year = logYearDir.isDir() && logYearDir.getSFN(sfn) ? parseLogName(sfn, 4, "") : 0;
+		while (ok && year && log_file.openNext(&logYearDir)) {
+			MonthEntry entry;
+			entry.month = log_file.isFile() && log_file.getSFN(sfn) ? parseLogName(sfn, 2, ".CSV") : 0;
+			if (entry.month) {
+				entry.month += year * 100UL;
+#ifdef ARDUINO
+				entry.dirIndex = log_file.dirIndex();
+#else
+				entry.dirIndex = 0;
+#endif
+				ok = addToCatalog(catalog, header, entry);
+			}
+			log_file.close();
+		}
+		logYearDir.close();
+	}
+	logDir.close();
+	catalog.close();
+	return ok;
+}
+
+//
+// Moves the yyyymm.csv files that older firmware left in the root
+// to /LOG/yyyy/mm.csv. The root scan restarts after each move.
+//
+void DataLoggerClass::migrateRootLogs() {
+	char path[] = "/LOG/yyyy/mm.csv";
+	char sfn[13]; // short file name
+	bool moved = true;
+	// Not resetLog(), as a rebuild can run from a log write. Callers have
+	// either finished the write or not yet written to log_file.
+	log_file.close();
+	while (moved) {
+		moved = false;
+		SD.chdir(true);	// The chdir forces a reset for the openNext
+		while (!moved && log_file.openNext(SD.vwd())) {
+			uint32_t month = log_file.isFile() && log_file.getSFN(sfn) ? parseLogName(sfn, 6, ".CSV") : 0;
+			if (month) {
+				setDigits(&path[sizeof(logDirName)], month / 100, 4);
+				setDigits(&path[sizeof(logDirName) + 5], month % 100, 2);
+				path[sizeof(logDirName) + 4] = 0;
+				bool haveDir = SD.exists(path) || SD.mkdir(path);
+				path[sizeof(logDirName) + 4] = '/';
+				moved = haveDir && log_file.rename(SD.vwd(), path);
+			}
+			log_file.close();
+		}
+	}
+	// Catalog of the root log files
+	SD.remove("months.cat");
+}
+
+//
+// Reads the next record from log_file into TMPBUF and returns the length
+// of its payload, or -1 at the end of the file.
+// A framed record is only returned if its length and crc match. Anything
+// else up to the next record marker or line is skipped and counted.
+// Unframed lines written before records were framed are returned for the
+// caller to check, up to a check marker that shows they are a damaged record.
+//
+int16_t DataLoggerClass::readRecord() {
+	char check[6];
+	int c = log_file.read();
+	while (c >= 0) {
+		if (c == '\r' || c == '\n') {
+			c = log_file.read();
+			continue;
+		}
+		bool framed = c == LOG_RECORD_START;
+		if (framed) {
+			c = log_file.read();
+		}
+		uint8_t length = 0;
+		while (c >= 0 && c != LOG_RECORD_CHECK && c != LOG_RECORD_START && c != '\n' &&
+			length < sizeof(TMPBUF) - 2) {	// Room for the terminator dumpLogFile adds
+			if (c != '\r') {
+				TMPBUF[length++] = c;
+			}
+			c = log_file.read();
+		}
+		TMPBUF[length] = 0;
+		if (framed && c == LOG_RECORD_CHECK) {
+			if (log_file.read(check, sizeof(check)) == sizeof(check) &&
+				parseHex(check, 2) == length &&
+				parseHex(&check[2], 4) == crc16(0xFFFF, TMPBUF, length)) {
+				return length;
+			}
+			c = log_file.read();
+		}
+		else if (!framed && c == '\n') {
+			return length;
+		}
+		skippedRecords++;
+		// Resync on the next record or line.
+		while (c >= 0 && c != LOG_RECORD_START && c != '\n') {
+			c = log_file.read();
+		}
+	}
+	return -1;
+}
+
+//
+// Sends the records from the current position of log_file to handler.
+// Records that fail their check, and older unframed lines that don't
+// parse, are skipped so one bad write doesn't hide the rest of the month.
+//
 void DataLoggerClass::dumpLogFile(updateEventHandler handler) {
 	// Caller must set log position.
 	// Note below is safe against missing values. Will just return null.
@@ -239,29 +699,34 @@ void DataLoggerClass::dumpLogFile(updateEventHandler handler) {
 	char* volts;
 	char* amps;
 	char* power;
+	char* ms;
 	int pos;
-	char* values[4];
+	char* values[5];
+	static char noMs[] = "0";
 
 	TMPBUF_ACQUIRE;
-	while (log_file.fgets2(TMPBUF, sizeof(TMPBUF)) > 0) {
+	while (readRecord() >= 0) {
 		pos = 0;
-
+		// getCsvString needs a terminator after the last value.
+		strcat(TMPBUF, "\n");
 		timestamp = getCsvString(TMPBUF, pos, pos);
 		volts = getCsvString(TMPBUF, pos, pos);
 		amps = getCsvString(TMPBUF, pos, pos);
 		power = getCsvString(TMPBUF, pos, pos);
+		ms = getCsvString(TMPBUF, pos, pos);	// Not in older logs
 		TMPBUF_RELEASE;	// Release before event handler is called.
-		if (!timestamp || !volts || !amps || !power) {
-
-			handler(0, 0, -1);
-			break;
+		if (!timestamp || !*timestamp ||
+			strspn(timestamp, "0123456789") != strlen(timestamp) ||
+			!volts || !amps || !power) {
+			skippedRecords++;
 		}
 		else {
 			values[0] = timestamp;
 			values[1] = volts;
 			values[2] = amps;
 			values[3] = power;
-			handler(values, 4, 0);
+			values[4] = ms ? ms : noMs;
+			handler(values, 5, 0);
 		}
 	}
 					
@@ -269,9 +734,201 @@ void DataLoggerClass::dumpLogFile(updateEventHandler handler) {
 }
 
 
+#ifdef LOG_RAW_DATA
+//
+// Opens the raw capture file, creating it if need be. It is allocated
+// in one go, so capture never allocates clusters or updates the directory.
+// The simulator fills it with zeros instead.
+//
+bool DataLoggerClass::openRawLog() {
+	rawFile.close();
+	rawLength = 0;
+	if (rawFile.open(rawFilename, O_RDWR) &&
+		rawFile.fileSize() == RAW_LOG_DATA_START + RAW_LOG_DATA_SIZE &&
+		rawFile.read(&rawHeader, sizeof(rawHeader)) == sizeof(rawHeader) &&
+		rawHeader.magic == RAW_LOG_MAGIC &&
+		rawHeader.head < RAW_LOG_DATA_SIZE) {
+		return rawFile.seekSet(RAW_LOG_DATA_START + rawHeader.head);
+	}
+	rawFile.close();
+	SD.remove(rawFilename);
+	rawHeader.head = 0;
+	rawHeader.magic = RAW_LOG_MAGIC;
+	rawHeader.wrapped = 0;
+	rawHeader.reserved = 0;
+#ifdef ARDUINO
+	bool created = rawFile.createContiguous(SD.vwd(), rawFilename, RAW_LOG_DATA_START + RAW_LOG_DATA_SIZE);
+#else
+	bool created = rawFile.open(rawFilename, O_RDWR | O_CREAT | O_TRUNC);
+	memset(rawBuffer, 0, sizeof(rawBuffer));
+	while (created && rawFile.fileSize() < RAW_LOG_DATA_START + RAW_LOG_DATA_SIZE) {
+		created = rawFile.write(rawBuffer, sizeof(rawBuffer)) == sizeof(rawBuffer);
+	}
+#endif
+	if (!created || !writeRawHeader() || !rawFile.seekSet(RAW_LOG_DATA_START)) {
+		rawFile.close();
+		return false;
+	}
+	return true;
+}
+
+// Writes the header without moving the file position.
+bool DataLoggerClass::writeRawHeader() {
+	uint32_t pos = rawFile.curPosition();
+	return rawFile.seekSet(0) &&
+		rawFile.write(&rawHeader, sizeof(rawHeader)) == sizeof(rawHeader) &&
+		rawFile.seekSet(pos);
+}
+
+//
+// Stages raw meter data in RAM, to be copied to the file by poll().
+// Only writes to the file here if poll() hasn't kept up.
+//
 void DataLoggerClass::logRawData(const char* buf, int len) {
+	if (!rawFile.isOpen()) {
+		return;
+	}
+	while (len > 0) {
+		if (rawLength == sizeof(rawBuffer)) {
+			flushRawLog();
+		}
+		uint8_t n = sizeof(rawBuffer) - rawLength;
+		if (len < n) {
+			n = len;
+		}
+		memcpy(&rawBuffer[rawLength], buf, n);
+		rawLength += n;
+		buf += n;
+		len -= n;
+	}
+}
+
+//
+// Copies the staged data to the file at head, wrapping at the end.
+// The header is only rewritten when head moves into the next block, which
+// also writes out the finished block. So after a power failure up to a
+// block of the newest capture is overwritten, and nothing older.
+// The data is dropped if it can't be written, as capture is only a diagnostic.
+//
+void DataLoggerClass::flushRawLog() {
+	uint8_t done = 0;
+	while (done < rawLength) {
+		uint8_t n = rawLength - done;
+		if (RAW_LOG_DATA_SIZE - rawHeader.head < n) {
+			n = RAW_LOG_DATA_SIZE - rawHeader.head;
+		}
+		if (rawFile.write(&rawBuffer[done], n) != n) {
+			break;
+		}
+		done += n;
+		uint32_t block = rawHeader.head / 512;
+		rawHeader.head += n;
+		if (rawHeader.head == RAW_LOG_DATA_SIZE) {
+			rawHeader.head = 0;
+			rawHeader.wrapped = 1;
+			rawFile.seekSet(RAW_LOG_DATA_START);
+		}
+		if (rawHeader.head / 512 != block) {
+			writeRawHeader();
+		}
+	}
+	rawLength = 0;
+}
+#endif
+
+uint32_t DataLoggerClass::alarmRecordPos(uint16_t record) {
+	return sizeof(AlarmJournalHeader) + (uint32_t)record * sizeof(Alarm);
+}
+
+//
+// Opens the alarm journal into log_file and loads the header.
+// A new or unrecognised journal is reset to empty.
+// Caller must close log_file.
+//
+bool DataLoggerClass::openAlarmJournal() {
 	resetLog();
-	log_file.open("raw.log", O_RDWR | O_CREAT | O_AT_END);
-	log_file.write(buf, len);
+	if (!log_file.open(alarmFilename, O_RDWR | O_CREAT)) {
+		return false;
+	}
+	if (log_file.read(&alarmJournal, sizeof(alarmJournal)) != sizeof(alarmJournal) ||
+		alarmJournal.recordSize != sizeof(Alarm) ||
+		alarmJournal.head >= ALARM_JOURNAL_RECORDS ||
+		alarmJournal.count > ALARM_JOURNAL_RECORDS) {
+		alarmJournal.recordSize = sizeof(Alarm);
+		alarmJournal.head = 0;
+		alarmJournal.count = 0;
+		return writeAlarmJournalHeader();
+	}
+	return true;
+}
+
+bool DataLoggerClass::writeAlarmJournalHeader() {
+	return log_file.seekSet(0) &&
+		log_file.write(&alarmJournal, sizeof(alarmJournal)) == sizeof(alarmJournal);
+}
+
+//
+// Appends an alarm to the journal. Only the record and the header
+// are written, so the cost doesn't depend on the size of the journal.
+//
+void DataLoggerClass::logAlarm(const Alarm& alarm) {
+	if (!is_initialised) return;
+
+	bool ok = openAlarmJournal() &&
+		log_file.seekSet(alarmRecordPos(alarmJournal.head)) &&
+		log_file.write(&alarm, sizeof(Alarm)) == sizeof(Alarm);
+	if (ok) {
+		alarmJournal.head = (alarmJournal.head + 1) % ALARM_JOURNAL_RECORDS;
+		if (alarmJournal.count < ALARM_JOURNAL_RECORDS) {
+			alarmJournal.count++;
+		}
+		ok = writeAlarmJournalHeader();
+	}
 	log_file.close();
-}
\ No newline at end of file
+	// Raising the error alarm re-enters logAlarm, so only
+	// do it once the journal has been closed.
+	if (!ok) {
+		checkWriteError(-1);
+	}
+}
+
+//
+// ::DESCRIPTION::
+// Reads count alarms from the journal, starting from the first'th
+// most recent alarm. 0 is the newest alarm.
+// handler is called for each alarm with its position relative to first.
+// Returns the number of alarms read.
+//
+uint16_t DataLoggerClass::dumpAlarms(uint16_t first, uint16_t count, alarmEventHandler handler) {
+	uint16_t position = 0;
+	if (!is_initialised || !openAlarmJournal()) {
+		log_file.close();
+		return 0;
+	}
+	Alarm alarm;
+	for (uint16_t i = first; i < alarmJournal.count && position < count; i++) {
+		uint16_t record = (alarmJournal.head + ALARM_JOURNAL_RECORDS - 1 - i) % ALARM_JOURNAL_RECORDS;
+		if (!log_file.seekSet(alarmRecordPos(record)) ||
+			log_file.read(&alarm, sizeof(alarm)) != sizeof(alarm)) {
+			break;
+		}
+		handler(alarm, position++);
+	}
+	log_file.close();
+	return position;
+}
+uint32_t DataLoggerClass::getCacheHits() {
+#ifdef ARDUINO
+	return SD.cacheHits();
+#else
+	return 0;
+#endif
+}
+
+uint32_t DataLoggerClass::getCacheMisses() {
+#ifdef ARDUINO
+	return SD.cacheMisses();
+#else
+	return 0;
+#endif
+}
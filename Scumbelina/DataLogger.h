@@ -4,9 +4,35 @@
 #define _DATALOGGER_h
 #include "HardwareConfig.h"
 #include "BatteryMeter.h"
+#include "AlarmLog.h"
 #include "SdFat.h"
 #include <stdio.h>
 
+// Number of alarms kept in the alarm journal on the SD card.
+// The journal is a circular file, so the oldest alarm is overwritten once full.
+#define ALARM_JOURNAL_RECORDS 1024
+// Longest log line: the record marker, timestamp,volts,amps,power,milliseconds,
+// the record check and CRLF.
+#define LOG_LINE_SIZE 48
+// Log records are $<payload>*<LL><CCCC>, where LL is the length of the payload
+// and CCCC its crc16, in hex. $ never appears in a payload, so a reader can
+// resync on it after a damaged record.
+#define LOG_RECORD_START '$'
+#define LOG_RECORD_CHECK '*'
+// Longest wait (ms) for the SD card to finish programming a write.
+#define LOG_WRITE_TIMEOUT 1000
+
+// Capture the data from the meter to a circular file, for replay in the simulator.
+// Cheap enough to leave on in the field. Comment out to save about 85 bytes of RAM.
+#define LOG_RAW_DATA
+// Bytes of capture kept. The oldest is overwritten once full.
+#define RAW_LOG_DATA_SIZE (1024UL * 1024UL)
+// The header has the first block to itself.
+#define RAW_LOG_DATA_START 512
+// Capture is staged in RAM and copied to the file between log writes.
+#define RAW_LOG_BUFFER_SIZE 32
+#define RAW_LOG_MAGIC 0x5752
+
 
 namespace Scumulator {
 	class DataLoggerTests;
@@ -18,37 +44,135 @@ class DataLoggerClass
 
 public:
 	typedef void(*updateEventHandler)(char** values, int8_t numValues, int8_t errorCode);
+	typedef void(*alarmEventHandler)(const Alarm& alarm, uint16_t position);
+	typedef void(*writeCompleteHandler)(bool ok);
+
+	// Stored at the start of the raw capture file. Once wrapped,
+	// the oldest data is at head.
+	struct RawLogHeader {
+		uint32_t head;		// Offset the next data goes to, after RAW_LOG_DATA_START
+		uint16_t magic;		// RAW_LOG_MAGIC
+		uint8_t wrapped;
+		uint8_t reserved;
+	};
 
 protected:
+	// Stored at the start of the alarm journal.
+	// head is the record the next alarm is written to.
+	struct AlarmJournalHeader {
+		uint8_t recordSize;
+		uint16_t head;
+		uint16_t count;
+	};
+
+	// Stored at the start of the month catalog.
+	struct CatalogHeader {
+		uint8_t recordSize;
+		uint16_t count;
+	};
+
+	// A monthly log file in the catalog. The catalog is sorted by month.
+	struct MonthEntry {
+		uint32_t month;		// yyyymm
+		uint16_t dirIndex;	// Entry of the file in its year directory
+	};
+
+	// Steps of a log write. Each step starts once the card has
+	// finished programming the blocks written by the last one.
+	enum { WriteIdle, WriteAppend, WriteFlushData, WriteFlushDir, WriteComplete };
+
 	const byte cs_pin = 4;
 	static char loggingFilename[];
+	static const char logDirName[];
+	static const char alarmFilename[];
+	static const char catalogFilename[];
+	static const char rawFilename[];
 	bool has_write_error = false;
 	bool is_initialised = false;
 	SdFat SD;
 	File log_file;
-	void setError(const char* msg);	// Note this must be a PROGMEM string
+	void setError(uint8_t alarmType);	// AL_MSG_xxx
 	void clearError();
-	void rtcInit();
-	void initLogFile(time_t timestamp);
-	void initLogFile(uint16_t year, uint8_t month);
-	void setLogFileName(uint16_t year, uint8_t month);
-	void setLogFileName(char* fn, uint16_t year, uint8_t month);
+	bool initLogFile(time_t timestamp);
+	void setDigits(char* s, uint16_t value, uint8_t digits);
+	uint32_t parseLogName(const char* sfn, uint8_t digits, const char* ext);
+	bool openYearDir(uint16_t year);
+	bool openMonthFile(uint8_t month, uint16_t dirIndex, uint8_t oflag);
 	void checkWriteError(int8_t val);
 	void dumpLogFile(updateEventHandler handler);
 	char* getCsvString(char* buf, int startPos, int& nextPos);
-	uint16_t logYear = -1;
-	uint8_t logMonth = -1;
+	bool openAlarmJournal();
+	bool writeAlarmJournalHeader();
+	uint32_t alarmRecordPos(uint16_t record);
+	bool openCatalog(File& catalog, CatalogHeader& header);
+	bool rebuildCatalog();
+	bool addToCatalog(File& catalog, CatalogHeader& header, const MonthEntry& entry);
+	bool readMonthEntry(File& catalog, uint16_t record, MonthEntry& entry);
+	uint32_t catalogRecordPos(uint16_t record);
+	bool catalogLogFile(uint32_t month);
+	void migrateRootLogs();
+	void recoverLogFile(const MonthEntry& entry);
+	uint32_t chainLength(uint32_t cluster);
+	AlarmJournalHeader alarmJournal;
+	time_t logMonthStart = 0;		// start of the month the open log file covers
+	uint32_t logMonthLength = 0;	// length of that month in seconds. 0 when no log file is known
+	File logYearDir;				// directory of the year being logged or dumped
+	uint16_t logYear = 0;			// year of logYearDir. 0 when it isn't open
+	uint16_t logFileIndex = 0;		// entry of the month's log file in logYearDir
 	time_t lastMillis = 0;
+
+	// Log line waiting to be written, and the progress of the write.
+	char writeLine[LOG_LINE_SIZE];
+	uint8_t writeLength = 0;
+	time_t writeTimestamp = 0;
+	uint8_t writeState = WriteIdle;
+	bool writeOk = false;
+	unsigned long writeStepStart = 0;
+	writeCompleteHandler writeHandler = NULL;
+
+	// Repairs made since power up
+	uint16_t tornBytes = 0;			// Bytes of lines cut short, removed at boot
+	uint16_t freedClusters = 0;		// Clusters beyond the end of the log file, freed at boot
+	uint16_t skippedRecords = 0;	// Corrupt lines skipped by dumps
+
+#ifdef LOG_RAW_DATA
+	File rawFile;
+	RawLogHeader rawHeader;
+	char rawBuffer[RAW_LOG_BUFFER_SIZE];
+	uint8_t rawLength = 0;
+	bool openRawLog();
+	void flushRawLog();
+	bool writeRawHeader();
+#endif
+	void formatLine(const BatteryMeasurement& value);
+	void setHex(char* s, uint16_t value, uint8_t digits);
+	int32_t parseHex(const char* s, uint8_t digits);
+	int16_t readRecord();
+	void startWrite(time_t timestamp, writeCompleteHandler handler);
+	void finishWrite();
+	bool cardBusy();
+	static void logWriteComplete(bool ok);
 public:
 	DataLoggerClass() {};
 	~DataLoggerClass();
 	
 	void init();
-	void setTime(uint16_t year, uint8_t month, uint8_t day, uint8_t hour, uint8_t minute, uint8_t second);
 	void newMeasurement(const BatteryMeasurement& value);
+	void poll();
 	//void dumpToSerial();
 	void dumpTo(uint32_t startDate, uint32_t endDate, updateEventHandler handler);
+#ifdef LOG_RAW_DATA
 	void logRawData(const char* buf, int len);
+#endif
+	void logAlarm(const Alarm& alarm);
+	uint16_t dumpAlarms(uint16_t first, uint16_t count, alarmEventHandler handler);
+	uint16_t getJournalAlarmCount() { return alarmJournal.count; }
+	// SD block cache use, to judge FAT_CACHE_SLOTS
+	uint32_t getCacheHits();
+	uint32_t getCacheMisses();
+	uint16_t getTornBytes() { return tornBytes; }
+	uint16_t getFreedClusters() { return freedClusters; }
+	uint16_t getSkippedRecords() { return skippedRecords; }
 	void resetLog();
 	void reset();
 };
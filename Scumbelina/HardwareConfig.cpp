@@ -7,7 +7,11 @@
 #include "..\SimulatedHardware\Button.h"
 //NullSerial Serial;
 FileEmulatedSerial Serial;
+#ifdef REPLAY_RAW_LOG
+RawReplayMeter Serial1;
+#else
 SimulatedSerialMeter Serial1;
+#endif
 unsigned long _millis_ADJ = 0;
 long TMPBUF_LINE = -1;
 wchar_t TMPBUF_FILE[1024] = L"";
@@ -27,6 +31,8 @@ SoftwareSerial Serial1(A1, A0);
 #include "SerialCommands.h"
 #include "Configuration.h"
 #include "AlarmLog.h"
+#include "RtcClock.h"
+#include "MemoryMonitor.h"
 
 //
 // The down-side of this is that construction order
@@ -37,8 +43,10 @@ SoftwareSerial Serial1(A1, A0);
 ConfigurationClass Configuration;
 BatteryMeterClass BatteryMeter;
 DataLoggerClass DataLogger;
+RtcClockClass RtcClock;
 SerialCommandsClass SerialCommands;
 AlarmLogClass AlarmLog;
+MemoryMonitorClass MemoryMonitor;
 #ifndef NO_DISPLAY
 ScumDisplayClass ScumDisplay;
 #else
@@ -47,6 +55,24 @@ ScumNoDisplayClass ScumDisplay;
 Button DisplayButton(6);
 Button MenuButton(5);
 // Must be large enough to fit a full meter reading (23 chars)
-// And to read/write to the datalogger (29 - 28 chars + \n)
-char TMPBUF[32];
-//time_t CURRENT_TIME;
\ No newline at end of file
+// And to read/write to the datalogger (34 - 33 chars + \n)
+char TMPBUF[36];
+//time_t CURRENT_TIME;
+
+#ifdef ARDUINO
+#include <util/crc16.h>
+#else
+static uint16_t _crc_ccitt_update(uint16_t crc, uint8_t data) {
+	data ^= (uint8_t)crc;
+	data ^= data << 4;
+	return ((((uint16_t)data << 8) | (crc >> 8)) ^ (uint8_t)(data >> 4) ^ ((uint16_t)data << 3));
+}
+#endif
+
+uint16_t crc16(uint16_t crc, const void* data, uint16_t len) {
+	const uint8_t* p = (const uint8_t*)data;
+	while (len--) {
+		crc = _crc_ccitt_update(crc, *p++);
+	}
+	return crc;
+}
@@ -26,13 +26,24 @@ typedef unsigned char byte;
 typedef char __FlashStringHelper;
 #define PROGMEM
 #define strlcpy_P strlcpy
+#define memcpy_P memcpy
+#define strcasecmp _stricmp
 
 // no gcc extensions
 #define __attribute__(x)
 #include "..\SimulatedHardware\eeprom.h"
 #include "..\SimulatedHardware\SoftwareSerial.h"
+#ifdef REPLAY_RAW_LOG
+// Replay a rawring.log capture instead of simulating the meter
+#include "RawReplay.h"
+extern class RawReplayMeter Serial1;
+// Times a stage of loop() for the replay report
+#define REPLAY_STAGE(stage, call) { Serial1.stageStart(); call; Serial1.stageEnd(stage); }
+#else
 #include "..\SimulatedHardware\SimulatedSerialMeter.h"
 extern class SimulatedSerialMeter Serial1;
+#define REPLAY_STAGE(stage, call) call
+#endif
 // Use NULL Serial if no serial output is required.
 //#include "..\SimulatedHardware\\NullSerial.h"
 //extern class NullSerial Serial;
@@ -81,6 +92,11 @@ inline time_t now() {
 	return time(&t);
 }
 
+inline time_t now(uint16_t& ms) {
+	ms = (uint16_t)(GetTickCount() % 1000);
+	return now();
+}
+
 inline int	hour(time_t t) {
 	struct tm* now_tm = localtime(&t);
 	return now_tm->tm_hour;
@@ -111,11 +127,57 @@ inline int	day(time_t t) {
 	return now_tm->tm_mday;
 }
 
+inline const tmElements_t& timeElements(time_t t) {
+	static tmElements_t elements;
+	struct tm* now_tm = localtime(&t);
+	elements.Second = now_tm->tm_sec;
+	elements.Minute = now_tm->tm_min;
+	elements.Hour = now_tm->tm_hour;
+	elements.Wday = now_tm->tm_wday + 1;
+	elements.Day = now_tm->tm_mday;
+	elements.Month = now_tm->tm_mon + 1;
+	elements.Year = now_tm->tm_year - 70;
+	return elements;
+}
+
+inline time_t makeTime(const tmElements_t& tm) {
+	struct tm make_tm = {};
+	make_tm.tm_sec = tm.Second;
+	make_tm.tm_min = tm.Minute;
+	make_tm.tm_hour = tm.Hour;
+	make_tm.tm_mday = tm.Day;
+	make_tm.tm_mon = tm.Month - 1;
+	make_tm.tm_year = tm.Year + 70;
+	make_tm.tm_isdst = -1;
+	return mktime(&make_tm);
+}
+
+inline time_t monthStart(time_t t) {
+	struct tm month_tm = *localtime(&t);
+	month_tm.tm_mday = 1;
+	month_tm.tm_hour = month_tm.tm_min = month_tm.tm_sec = 0;
+	month_tm.tm_isdst = -1;
+	return mktime(&month_tm);
+}
+
+inline time_t nextMonthStart(time_t t) {
+	struct tm month_tm = *localtime(&t);
+	month_tm.tm_mday = 1;
+	month_tm.tm_mon++;
+	month_tm.tm_hour = month_tm.tm_min = month_tm.tm_sec = 0;
+	month_tm.tm_isdst = -1;
+	return mktime(&month_tm);
+}
+
 
 inline void setTime(int hr, int min, int sec, int day, int month, int yr) {
 	// do nothing for now.
 }
 
+inline void setTime(time_t t) {
+	// do nothing for now.
+}
+
 inline timeStatus_t timeStatus() {
 	return timeSet;
 }
@@ -176,6 +238,7 @@ extern bool TMPBUF_ACQUIRED;
 
 #define TMPBUF_ACQUIRE 
 #define TMPBUF_RELEASE 
+#define REPLAY_STAGE(stage, call) call
 
 
 extern class SoftwareSerial Serial1;
@@ -183,12 +246,17 @@ extern class SoftwareSerial Serial1;
 
 extern class BatteryMeterClass BatteryMeter;
 extern class DataLoggerClass DataLogger;
+extern class RtcClockClass RtcClock;
 extern class Button DisplayButton;
 extern class Button MenuButton;
 extern class AlarmLogClass AlarmLog;
 extern class SerialCommandsClass SerialCommands;
 extern class ConfigurationClass Configuration;
-extern char TMPBUF[32];
+extern class MemoryMonitorClass MemoryMonitor;
+extern char TMPBUF[36];
+
+// CRC-16/CCITT as calculated by _crc_ccitt_update. Start with a crc of 0xFFFF.
+uint16_t crc16(uint16_t crc, const void* data, uint16_t len);
 #ifndef NO_DISPLAY
 extern class ScumDisplayClass ScumDisplay;
 #else 
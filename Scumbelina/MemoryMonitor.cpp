@@ -0,0 +1,71 @@
+//
+//
+//
+#include "MemoryMonitor.h"
+
+#ifdef ARDUINO
+// Linker symbols. _end is the end of .bss, __stack the top of RAM.
+extern uint8_t __data_start;
+extern uint8_t _end;
+extern uint8_t __stack;
+extern char* __brkval;
+
+// Runs from .init3, after the stack pointer is set up and before
+// .data and .bss are initialised, so it must not use the stack or globals.
+void paintRam() __attribute__((naked, used, section(".init3")));
+void paintRam() {
+	uint8_t* p = &_end;
+	while (p <= &__stack) {
+		*p++ = MEMORY_CANARY;
+	}
+}
+
+// Bottom of the free RAM. There is no malloc in this code, but libraries may use it.
+static uint8_t* heapEnd() {
+	return __brkval ? (uint8_t*)__brkval : &_end;
+}
+#endif
+
+void MemoryMonitorClass::init() {
+	// Before anything uses it
+	memset(TMPBUF, MEMORY_CANARY, sizeof(TMPBUF));
+}
+
+uint16_t MemoryMonitorClass::freeRam() {
+#ifdef ARDUINO
+	uint8_t top;
+	return &top - heapEnd();
+#else
+	return 0;
+#endif
+}
+
+uint16_t MemoryMonitorClass::stackHeadroom() {
+#ifdef ARDUINO
+	const uint8_t* p = heapEnd();
+	uint16_t count = 0;
+	while (p <= &__stack && *p == MEMORY_CANARY) {
+		p++;
+		count++;
+	}
+	return count;
+#else
+	return 0;
+#endif
+}
+
+uint16_t MemoryMonitorClass::staticRam() {
+#ifdef ARDUINO
+	return &_end - &__data_start;
+#else
+	return 0;
+#endif
+}
+
+uint8_t MemoryMonitorClass::tmpbufHighWater() {
+	uint8_t used = sizeof(TMPBUF);
+	while (used > 0 && (uint8_t)TMPBUF[used - 1] == MEMORY_CANARY) {
+		used--;
+	}
+	return used;
+}
@@ -0,0 +1,32 @@
+// MemoryMonitor.h
+
+#ifndef _MEMORYMONITOR_h
+#define _MEMORYMONITOR_h
+#include "HardwareConfig.h"
+
+// Value painted over unused RAM. Unlikely to be written by real data.
+#define MEMORY_CANARY 0xC5
+
+//
+// DESCRIPTION::
+//
+// Reports how much of the 2K of SRAM is in use while running.
+//
+// The RAM between the static data and the stack is painted with MEMORY_CANARY
+// before main() starts. The stack overwrites it as it grows, so the painted
+// bytes left give the closest the stack has come to the static data.
+// TMPBUF is painted the same way to show how much of it is ever used.
+//
+// Use Tools/RamReport.py on a build to see the static RAM used by each module.
+//
+class MemoryMonitorClass
+{
+public:
+	void init();
+	uint16_t freeRam();			// Currently between the heap and the stack
+	uint16_t stackHeadroom();	// Least free RAM there has ever been
+	uint16_t staticRam();		// .data and .bss
+	uint8_t tmpbufHighWater();	// Most of TMPBUF ever used
+};
+
+#endif
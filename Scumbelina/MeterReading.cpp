@@ -144,3 +144,29 @@ const char* MeterReading::toString(char* buffer, uint8_t num_int, uint8_t num_de
 	return buffer;
 }
 
+// Returns -1 if the reading contains an error digit.
+int16_t MeterReading::toHundredths() const
+{
+	int16_t result = 0;
+	for (uint8_t i = 0; i < METER_READING_STRLEN - 1; i++) {
+		if (i == METER_READING_NUM_INT) continue;	// decimal place
+		char c = value[i];
+		if (c < '0' || c > '9') return -1;
+		result = result * 10 + (c - '0');
+	}
+	return result;
+}
+
+void MeterReading::setHundredths(uint16_t hundredths)
+{
+	for (int8_t i = METER_READING_STRLEN - 2; i >= 0; i--) {
+		if (i == METER_READING_NUM_INT) {
+			value[i] = '.';
+		}
+		else {
+			value[i] = '0' + (hundredths % 10);
+			hundredths /= 10;
+		}
+	}
+	value[METER_READING_STRLEN - 1] = 0;
+}
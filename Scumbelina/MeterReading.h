@@ -42,6 +42,11 @@ public:
 	const char* toString() const;
 	const char* toString(char* buffer, uint8_t num_int, uint8_t num_dec, bool spacePad = false, bool is_set = true) const;
 
+	// Integer value in hundredths, e.g. 12.34 is 1234.
+	// Allows simple integer math without floating point support.
+	int16_t toHundredths() const;
+	void setHundredths(uint16_t hundredths);
+
 private:
 	char value[METER_READING_STRLEN];
 	static const char unset_value[METER_READING_STRLEN];
@@ -0,0 +1,138 @@
+//
+//
+//
+#ifndef ARDUINO
+#include "RawReplay.h"
+#include "DataLogger.h"
+
+bool RawReplayMeter::open(const char* path) {
+	close();
+	file = fopen(path, "rb");
+	polls = frames = bytes = 0;
+	memset(stages, 0, sizeof(stages));
+	QueryPerformanceCounter(&replayStarted);
+	startMillis = millis();
+	if (!file) {
+		return false;
+	}
+	DataLoggerClass::RawLogHeader header;
+	ring = fread(&header, sizeof(header), 1, file) == 1 &&
+		header.magic == RAW_LOG_MAGIC && header.head < RAW_LOG_DATA_SIZE;
+	if (ring) {
+		// Oldest first. Until it wraps, the data ends at head.
+		ringPos = header.wrapped ? header.head : 0;
+		remaining = header.wrapped ? RAW_LOG_DATA_SIZE : header.head;
+		fseek(file, RAW_LOG_DATA_START + ringPos, SEEK_SET);
+	}
+	else {
+		rewind(file);
+	}
+	return true;
+}
+
+int RawReplayMeter::nextByte() {
+	if (!ring) {
+		return fgetc(file);
+	}
+	if (remaining == 0) {
+		return EOF;
+	}
+	remaining--;
+	if (++ringPos == RAW_LOG_DATA_SIZE) {
+		int c = fgetc(file);
+		ringPos = 0;
+		fseek(file, RAW_LOG_DATA_START, SEEK_SET);
+		return c;
+	}
+	return fgetc(file);
+}
+
+void RawReplayMeter::close() {
+	if (file) {
+		fclose(file);
+		file = NULL;
+	}
+	frameLength = framePos = 0;
+}
+
+// Reads up to and including the next 'W', which ends a meter frame.
+void RawReplayMeter::loadFrame() {
+	frameLength = framePos = 0;
+	int c;
+	while (frameLength < sizeof(frame) && (c = nextByte()) != EOF) {
+		frame[frameLength++] = (char)c;
+		if (c == 'W') {
+			break;
+		}
+	}
+	if (c == EOF) {
+		close();
+		report(stdout);
+		return;
+	}
+	frames++;
+	bytes += frameLength;
+}
+
+int RawReplayMeter::available() {
+	return frameLength - framePos;
+}
+
+size_t RawReplayMeter::readBytes(char* buffer, size_t length) {
+	size_t n = frameLength - framePos;
+	if (n > length) {
+		n = length;
+	}
+	memcpy(buffer, frame + framePos, n);
+	framePos += (uint8_t)n;
+	return n;
+}
+
+size_t RawReplayMeter::println(const char* s) {
+	polls++;
+	// Like the meter, a poll while still sending is ignored.
+	if (file && framePos == frameLength) {
+		loadFrame();
+	}
+	return strlen(s) + 2;
+}
+
+void RawReplayMeter::stageStart() {
+	QueryPerformanceCounter(&stageStarted);
+}
+
+void RawReplayMeter::stageEnd(ReplayStage stage) {
+	LARGE_INTEGER now;
+	QueryPerformanceCounter(&now);
+	LONGLONG ticks = now.QuadPart - stageStarted.QuadPart;
+	StageTime& time = stages[stage];
+	time.calls++;
+	time.total += ticks;
+	if (ticks > time.worst) {
+		time.worst = ticks;
+	}
+}
+
+void RawReplayMeter::report(FILE* out) {
+	static const char* const names[REPLAY_STAGES] = { "RTC", "Buttons", "Meter", "Logger", "Display", "Serial" };
+	LARGE_INTEGER now, frequency;
+	QueryPerformanceCounter(&now);
+	QueryPerformanceFrequency(&frequency);
+	double hostSecs = (double)(now.QuadPart - replayStarted.QuadPart) / frequency.QuadPart;
+	double simSecs = (millis() - startMillis) / 1000.0;
+	double usPerTick = 1e6 / frequency.QuadPart;
+
+	fprintf(out, "Replayed %lu frames, %lu bytes for %lu polls\n",
+		(unsigned long)frames, (unsigned long)bytes, (unsigned long)polls);
+	if (hostSecs > 0) {
+		fprintf(out, "%.1f s simulated in %.2f s: %.0f frames/s, %.0fx real time\n",
+			simSecs, hostSecs, frames / hostSecs, simSecs / hostSecs);
+	}
+	fprintf(out, "%-8s %10s %10s %10s\n", "Stage", "Calls", "Mean us", "Worst us");
+	for (uint8_t i = 0; i < REPLAY_STAGES; i++) {
+		const StageTime& time = stages[i];
+		fprintf(out, "%-8s %10lu %10.1f %10.1f\n", names[i], (unsigned long)time.calls,
+			time.calls ? time.total * usPerTick / time.calls : 0.0, time.worst * usPerTick);
+	}
+}
+#endif
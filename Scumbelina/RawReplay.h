@@ -0,0 +1,77 @@
+// RawReplay.h
+
+#ifndef _RAWREPLAY_h
+#define _RAWREPLAY_h
+#include "HardwareConfig.h"
+#include <stdio.h>
+
+// Longest frame expected from the meter, e.g. " 12.34V 1.23A 15.18W"
+#define RAW_REPLAY_FRAME_SIZE 32
+
+// Stages of loop() timed during a replay. The meter stage includes the
+// measurement handlers: min/max, alarms, logger and the display model.
+enum ReplayStage { ReplayRtc, ReplayButtons, ReplayMeter, ReplayLogger, ReplayDisplay, ReplaySerial, REPLAY_STAGES };
+
+//
+// DESCRIPTION::
+//
+// Simulator stand in for the meter on Serial1 that replays a capture made
+// with LOG_RAW_DATA, so field captures can be soaked through the
+// parser, min/max, alarms, logger and display. Takes the rawring.log
+// ring file, oldest data first, or an older plain raw.log.
+//
+// The meter only sends when it is polled, so each poll releases the next
+// frame of the capture. Replay therefore keeps pace with the simulated
+// clock however fast it runs.
+//
+// loop() times each stage with REPLAY_STAGE. When the capture runs out the
+// throughput, the speed against real time and the mean and worst time of
+// each stage are written to stdout.
+// Stack use isn't reported. The host stack says nothing about the AVR's,
+// so that is left to MemoryMonitor on a device (the diagnostics command).
+//
+// Select it with REPLAY_RAW_LOG in place of the SimulatedSerialMeter.
+//
+class RawReplayMeter
+{
+protected:
+	FILE* file = NULL;
+	char frame[RAW_REPLAY_FRAME_SIZE];
+	uint8_t frameLength = 0;
+	uint8_t framePos = 0;
+	bool ring = false;		// Replaying a ring file
+	uint32_t ringPos = 0;	// Offset of the next byte in the ring
+	uint32_t remaining = 0;	// Bytes left to replay in the ring
+
+	struct StageTime {
+		uint32_t calls;
+		LONGLONG total;		// Performance counter ticks
+		LONGLONG worst;
+	};
+	StageTime stages[REPLAY_STAGES];
+	LARGE_INTEGER stageStarted;
+	LARGE_INTEGER replayStarted;
+	unsigned long startMillis = 0;	// Simulated time the replay started
+
+	int nextByte();
+	void loadFrame();
+public:
+	uint32_t polls = 0;		// Polls from the firmware
+	uint32_t frames = 0;	// Frames replayed
+	uint32_t bytes = 0;		// Bytes replayed
+
+	bool open(const char* path);
+	void close();
+	bool finished() const { return file == NULL && framePos == frameLength; }
+	void stageStart();
+	void stageEnd(ReplayStage stage);
+	void report(FILE* out);
+
+	// The parts of the Serial1 interface that BatteryMeter uses
+	void begin(long) {}
+	int available();
+	size_t readBytes(char* buffer, size_t length);
+	size_t println(const char* s);
+};
+
+#endif
@@ -0,0 +1,191 @@
+//
+//
+//
+#include "RtcClock.h"
+#include <DS3232RTC.h>
+#include "Configuration.h"
+
+void RtcClockClass::init()
+{
+	// Turn off unneeded outputs to save battery
+	RTC.set33kHzOutput(false);
+	RTC.setSQIMode(sqiModeNone);
+
+	// Right to the second for now. process() syncs on the next edge.
+	time_t t = RTC.get();
+	if (t != 0) {
+		::setTime(t);
+	}
+}
+
+// Finds the RTC seconds edges without blocking.
+// Only polls the RTC while a sync is due, or a host sync is running.
+void RtcClockClass::process() {
+	if (writeTime != 0) {
+		if (millis() - writeMillis >= writeWait) {
+			writeHostTime();
+		}
+	}
+	else if (edgeTime == 0) {
+		if (hostTime != 0 || (int32_t)(millis() - syncMillis) >= 0) {
+			startEdgeWait();
+		}
+	}
+	else {
+		time_t t = RTC.get();
+		if (t != edgeTime) {
+			edgeFound(t, false);
+		}
+		else if (millis() - edgeMillis > RTC_EDGE_TIMEOUT) {
+			edgeFound(t, true);
+		}
+	}
+}
+
+void RtcClockClass::startEdgeWait() {
+	edgeTime = RTC.get();
+	edgeMillis = millis();
+	if (edgeTime == 0) {
+		// RTC not responding.
+		edgeFound(0, true);
+	}
+}
+
+// Called when the RTC ticks over, or the wait for it times out.
+void RtcClockClass::edgeFound(time_t t, bool timedOut) {
+	unsigned long edge = millis();
+	edgeTime = 0;
+	if (!timedOut && t != 0 && syncTime != 0 && hostTime == 0) {
+		// How far the edge was from the prediction. An edge that came before
+		// the polling started is missed, so t can be a second past syncTime.
+		int32_t late = (int32_t)(edge - syncMillis - RTC_EDGE_LEAD) - (int32_t)(t - syncTime) * 1000L;
+		if (labs(late) < 500) {
+			edgeSkew += (int16_t)late;
+		}
+	}
+	if (hostTime != 0) {
+		compareToHost(t, edge);
+	}
+	else {
+		syncClock(t, edge);
+	}
+	if (timedOut) {
+		// There was no edge to predict the next one from.
+		syncTime = 0;
+	}
+}
+
+// Call on an RTC seconds edge.
+void RtcClockClass::syncClock(time_t t, unsigned long edge) {
+	if (t != 0) {
+		::setTime(t);
+		syncTime = t + RTC_SYNC_INTERVAL;
+		syncMillis = edge + RTC_SYNC_INTERVAL * 1000UL + edgeSkew - RTC_EDGE_LEAD;
+	}
+	else {
+		// RTC not responding. Try again later.
+		syncTime = 0;
+		syncMillis = edge + RTC_SYNC_INTERVAL * 1000UL;
+	}
+}
+
+void RtcClockClass::setTime(uint16_t year, uint8_t month, uint8_t day, uint8_t hour, uint8_t minute, uint8_t second) {
+	tmElements_t tm;
+	tm.Year = CalendarYrToTm(year);
+	tm.Month = month;
+	tm.Day = day;
+	tm.Hour = hour;
+	tm.Minute = minute;
+	tm.Second = second;
+	RTC.write(tm);
+	// Writing the seconds restarts the RTC second, so this is an edge.
+	edgeTime = 0;
+	writeTime = 0;
+	syncClock(makeTime(tm), millis());
+
+	// Only accurate to the second, so can't be used to measure drift.
+	ConfigurationClass::Config& config = Configuration.getConfig();
+	if (config.clockSyncTime != 0) {
+		config.clockSyncTime = 0;
+		Configuration.saveConfig();
+	}
+}
+
+bool RtcClockClass::syncToHost(time_t time, uint16_t ms) {
+	if (time == 0 || hostTime != 0 || writeTime != 0) {
+		return false;
+	}
+	hostTime = time;
+	hostMs = ms;
+	hostMillis = millis();
+	return true;
+}
+
+void RtcClockClass::syncHandler(syncEventHandler handler) {
+	syncCallback = handler;
+}
+
+// Compares the host time with the RTC on an edge, so the RTC time is exact to the millisecond.
+void RtcClockClass::compareToHost(time_t rtcTime, unsigned long edge) {
+	// Host time at the edge, in ms after hostTime
+	uint32_t hostOffset = hostMs + (edge - hostMillis);
+	int32_t error = RTC_MAX_DRIFT_ERROR;
+	if (rtcTime != 0) {
+		error = (int32_t)(rtcTime - hostTime) * 1000L - (int32_t)hostOffset;
+	}
+
+	ConfigurationClass::Config& config = Configuration.getConfig();
+	uint32_t elapsed = hostTime - config.clockSyncTime;
+	int16_t drift = 0;
+	if (config.clockSyncTime != 0 &&
+		elapsed >= RTC_MIN_DRIFT_PERIOD &&
+		labs(error) < RTC_MAX_DRIFT_ERROR) {
+		// Tenths of ppm. Scaled to avoid overflowing.
+		int32_t ppm = error * 100L / (int32_t)(elapsed / 100);
+		// Far beyond what the aging offset can correct anyway.
+		drift = (int16_t)(ppm > 2540 ? 2540 : (ppm < -2540 ? -2540 : ppm));
+	}
+
+	if (config.clockSyncTime != 0 && labs(error) < RTC_SYNC_TOLERANCE && drift == 0) {
+		// Nothing to correct. Leave the RTC and the original sync alone so
+		// the drift is measured over a longer period next time.
+		syncClock(rtcTime, edge);
+	}
+	else {
+		if (drift != 0) {
+			// An aging offset step is about 0.1ppm, the same unit as the drift.
+			int16_t aging = getAgingOffset() + drift;
+			if (aging > 127) aging = 127;
+			if (aging < -127) aging = -127;
+#ifdef ARDUINO
+			RTC.writeAgingOffset((int8_t)aging);
+#endif
+		}
+		// The RTC restarts its second when the seconds are written.
+		// So wait for the next host second and write that.
+		writeTime = hostTime + hostOffset / 1000 + 1;
+		writeWait = 1000 - hostOffset % 1000;
+		writeMillis = edge;
+	}
+	hostTime = 0;
+	if (syncCallback) syncCallback(error, drift);
+}
+
+// Writes the host time on its second edge, and saves it as the start of the drift measurement.
+void RtcClockClass::writeHostTime() {
+	tmElements_t tm = timeElements(writeTime);
+	RTC.write(tm);
+	syncClock(writeTime, millis());
+
+	Configuration.getConfig().clockSyncTime = writeTime;
+	Configuration.saveConfig();
+	writeTime = 0;
+}
+
+int8_t RtcClockClass::getAgingOffset() {
+#ifdef ARDUINO
+	return RTC.readAgingOffset();
+#else
+	return 0;
+#endif
+}
@@ -0,0 +1,80 @@
+// RtcClock.h
+
+#ifndef _RTCCLOCK_h
+#define _RTCCLOCK_h
+#include "HardwareConfig.h"
+#include <Time.h>
+
+// Seconds between re-syncing the system clock to the RTC.
+// millis() runs off the resonator which is far less accurate than the RTC
+// so this bounds the error in the millisecond part of a timestamp.
+#define RTC_SYNC_INTERVAL 60
+// Longest wait for the RTC seconds to tick over before giving up.
+#define RTC_EDGE_TIMEOUT 1100
+// How long (ms) before the predicted edge to start polling the RTC.
+// Covers the jitter in the resonator error between syncs.
+#define RTC_EDGE_LEAD 20
+// Minimum seconds between host syncs before the drift is measured.
+// Over a shorter period the serial latency swamps the drift.
+#define RTC_MIN_DRIFT_PERIOD 86400UL
+// Errors larger than this (ms) are assumed to be a change of time
+// (e.g. daylight savings) rather than drift, so the aging offset is left alone.
+#define RTC_MAX_DRIFT_ERROR 600000L
+// Errors smaller than this (ms) are left to accumulate until the drift can be measured.
+#define RTC_SYNC_TOLERANCE 500
+
+//
+// DESCRIPTION::
+//
+// Keeps the system clock in step with the DS3232.
+// The system clock is re-synced on an RTC seconds edge so that
+// now(ms) gives millisecond timestamps that agree with the RTC.
+// The SQI pin is not connected, so edges are found by polling the RTC.
+// The resonator error is steady, so polling starts just before where
+// the last sync predicts the edge rather than a second ahead of it.
+//
+// When the host syncs the clock, the error since the previous host sync gives the
+// drift of the RTC, which is trimmed out with the DS3232 aging offset.
+// The sync runs from process(), and the result is passed to the sync handler.
+// The sync time is only saved when the clock or aging offset is corrected,
+// so repeated syncs with nothing to correct don't wear the EEPROM.
+//
+class RtcClockClass
+{
+public:
+	// Clock error in ms, positive when the clock is fast, and the measured
+	// drift in tenths of ppm, or 0 if it could not be measured.
+	typedef void(*syncEventHandler)(int32_t error, int16_t drift);
+
+	RtcClockClass() { syncCallback = 0; }
+
+	void init();
+	void process();
+	void setTime(uint16_t year, uint8_t month, uint8_t day, uint8_t hour, uint8_t minute, uint8_t second);
+	// Starts a sync to the host time. Returns false if a sync is already running.
+	bool syncToHost(time_t hostTime, uint16_t hostMs);
+	void syncHandler(syncEventHandler handler);
+	int8_t getAgingOffset();
+
+protected:
+	syncEventHandler syncCallback;
+	unsigned long syncMillis = 0;	// When to start polling for the next edge.
+	time_t syncTime = 0;			// RTC time expected from that edge. 0 if not predicted.
+	int16_t edgeSkew = 0;			// How far (ms) the RTC gains on millis() over a sync interval.
+	time_t edgeTime = 0;			// RTC time while waiting for it to tick. 0 when not waiting.
+	unsigned long edgeMillis = 0;	// When the wait started.
+	time_t hostTime = 0;			// Host time to sync to. 0 when not syncing.
+	uint16_t hostMs = 0;
+	unsigned long hostMillis = 0;	// When the host time was received.
+	time_t writeTime = 0;			// Time to write to the RTC. 0 when none is waiting.
+	unsigned long writeMillis = 0;
+	uint16_t writeWait = 0;			// ms after writeMillis that writeTime starts.
+
+	void startEdgeWait();
+	void edgeFound(time_t t, bool timedOut);
+	void syncClock(time_t t, unsigned long edge);
+	void compareToHost(time_t rtcTime, unsigned long edge);
+	void writeHostTime();
+};
+
+#endif
@@ -36,15 +36,18 @@ void ScumDisplayClass::reset(void) {
 	measurementChanged = true;
 	alarmChanged = true;
 	currentPage = 0;
-	// re-initialise here because sd card errors can
-	// slow down the speed of the SPI bus.
-	// re-initting the oled display will restore it to full speed.
-	init();
+	initMainPage();
+	keepAlive();
 	updateMainPage();
 }
 
 void ScumDisplayClass::showNextPage() {
-	currentPage = !currentPage;
+	currentPage++;
+	if (currentPage > 1 &&
+		(uint16_t)(currentPage - 2) * ALARMS_PER_PAGE >= DataLogger.getJournalAlarmCount()) {
+		// Past the end of the alarm history.
+		currentPage = 0;
+	}
 	if (currentPage == 0) {
 		initMainPage();
 		measurementChanged = true;
@@ -113,25 +116,41 @@ void ScumDisplayClass::initAlarmPage() {
 	oled.clearScreen();
 	oled.selectFont(Arial_Black_16);
 	oled.drawString(25, 100, F("ALARMS"), RED, BLACK);
+	if (currentPage > 1) {
+		oled.selectFont(Arial14);
+		TMPBUF_ACQUIRE;
+		// Moved left to fit three digits
+		oled.drawString(currentPage < 100 ? 108 : 100, 102, itoa(currentPage, TMPBUF, 10), WHITE, BLACK);
+		TMPBUF_RELEASE;
+	}
 	updateAlarmPage();
 }
 
 void ScumDisplayClass::updateAlarmPage() {
 	if (alarmChanged) {
 		oled.selectFont(Arial14);
-		uint8_t yval = 82;
-		TMPBUF_ACQUIRE;
-		for (uint8_t i = 0; i < AlarmLog.getAlarmCount(); i++) {
-			formatDateTime(TMPBUF, AlarmLog.alarms[i].timestamp);
-			oled.drawString(2, yval, TMPBUF, RED, BLACK);
-			oled.drawString(2, yval - 14, AlarmLog.alarms[i].message, RED, BLACK);
-			yval -= 34;
+		if (currentPage == 1) {
+			for (uint8_t i = 0; i < AlarmLog.getAlarmCount(); i++) {
+				drawAlarm(AlarmLog.getAlarm(i), i);
+			}
+		}
+		else {
+			DataLogger.dumpAlarms((currentPage - 2) * ALARMS_PER_PAGE, ALARMS_PER_PAGE, drawAlarm);
 		}
-		TMPBUF_RELEASE;
 	}
 	alarmChanged = false;
 }
 
+void ScumDisplayClass::drawAlarm(const Alarm& alarm, uint16_t position) {
+	uint8_t yval = 82 - position * 34;
+	TMPBUF_ACQUIRE;
+	ScumDisplay.formatDateTime(TMPBUF, alarm.timestamp);
+	ScumDisplay.oled.drawString(2, yval, TMPBUF, RED, BLACK);
+	AlarmLog.formatAlarm(TMPBUF, alarm);
+	ScumDisplay.oled.drawString(2, yval - 14, TMPBUF, RED, BLACK);
+	TMPBUF_RELEASE;
+}
+
 void ScumDisplayClass::newMeasurement(const BatteryMeasurement& value) {
 	// Not updating the display here. Waiting for the poll loop to call process().
 	// Probably can just update it directly??
@@ -164,9 +183,10 @@ void ScumDisplayClass::keepAlive() {
 
 // Format is "hh:mm:ss" - Note buf must be 10 chars long
 void ScumDisplayClass::formatTime(char* buf, time_t value) {
-	int hours = hour(value);
-	int mins = minute(value);
-	int secs = second(value);
+	const tmElements_t& tm = timeElements(value);
+	int hours = tm.Hour;
+	int mins = tm.Minute;
+	int secs = tm.Second;
 
 	buf[0] = '0' + (hours / 10);
 	buf[1] = '0' + (hours % 10);
@@ -183,9 +203,10 @@ void ScumDisplayClass::formatTime(char* buf, time_t value) {
 
 // Format is DD/MM/YY hh:mm:ss - Buf must be 19 chars
 void ScumDisplayClass::formatDateTime(char* buf, time_t value) {
-	int years = year(value) % 100;
-	int months = month(value);
-	int days = day(value);	
+	const tmElements_t& tm = timeElements(value);
+	int years = tmYearToCalendar(tm.Year) % 100;
+	int months = tm.Month;
+	int days = tm.Day;
 
 	buf[0] = '0' + days / 10;
 	buf[1] = '0' + (days % 10);
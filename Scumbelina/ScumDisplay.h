@@ -5,6 +5,7 @@
 #include "HardwareConfig.h"
 #include <FTOLED.h>
 #include "BatteryMeter.h"
+#include "AlarmLog.h"
 
 #include <fonts/Arial_Black_16_Custom.h>
 #define Arial_Black_16 Arial_Black_16_Custom
@@ -19,6 +20,10 @@ namespace Scumulator {
 //
 // DESCRIPTION::
 //
+// Page 0 is the main page. Page 1 shows the active alarms.
+// Pages 2 onwards show the alarm history from the journal on the SD card,
+// most recent first.
+//
 // KNOW ISSUES::
 //
 // Don't display correctly when the alarm page scrolls while we are viewing it.
@@ -26,6 +31,8 @@ namespace Scumulator {
 // could do a clearScreen on new alarms as a simple fix.
 //
 
+static const byte ALARMS_PER_PAGE = 3;
+
 static const byte pin_cs = 7;
 static const byte pin_dc = 2;
 static const byte pin_reset = 3;
@@ -36,7 +43,7 @@ class ScumDisplayClass
 
 private:
 protected:
-	uint8_t currentPage = 0;
+	uint16_t currentPage = 0;	// Enough for every page of a full alarm journal
 	OLED oled;
 	unsigned long turn_off_millis;
 
@@ -48,6 +55,7 @@ protected:
 	void updateMainPage();
 	void initAlarmPage();
 	void updateAlarmPage();
+	static void drawAlarm(const Alarm& alarm, uint16_t position);
 
 	void formatTime(char* buf, time_t value);
 	void formatDateTime(char* buf, time_t value);
@@ -65,7 +73,7 @@ public:
 	void showDisplay(bool show);
 	void showNextPage();
 	void toggleDisplay();
-	byte getCurrentPage() { return currentPage;  }
+	uint16_t getCurrentPage() { return currentPage;  }
 
 	//void displayError(char* error);
 	// Ping the display to keep it on.
@@ -25,10 +25,10 @@ public:
 	void showDisplay(bool show) { }
 	void showNextPage() { currentPage = !currentPage; }
 	void toggleDisplay() { }
-	byte getCurrentPage() { return currentPage;  }
+	uint16_t getCurrentPage() { return currentPage;  }
 	void keepAlive() { }
 private:
-	uint8_t currentPage;
+	uint16_t currentPage;
 };
 
 
@@ -6,8 +6,11 @@
 #include "SerialCommands.h"
 #include "AlarmLog.h"
 #include "Configuration.h"
+#include "RtcClock.h"
+#include "MemoryMonitor.h"
 // Function prototypes to support the WIN32 environment
 void newBatteryMeasurement(const BatteryMeasurement& value);
+void newRawMeterData(const char* data, uint8_t length);
 void displayButtonClicked(Button& but);
 void menuButtonPressed(Button& but);
 void menuButtonHeld(Button& but);
@@ -59,17 +62,20 @@ void menuButtonHeld(Button& but);
 
 
 void setup() {
-	Serial.begin(115200);
+	MemoryMonitor.init();
+	Serial.begin(LINK_DEFAULT_BAUD);
 	Serial1.begin(9600);
 //	CURRENT_TIME = now();
 
 	// Note need to initialise the configuration first
 	Configuration.init();
+	RtcClock.init();
 	AlarmLog.init();
 	DisplayButton.clickHandler(displayButtonClicked);
 	MenuButton.clickHandler(menuButtonPressed);
 	MenuButton.holdHandler(menuButtonHeld, 1000);
 	BatteryMeter.measurementHandler(newBatteryMeasurement);
+	BatteryMeter.rawDataHandler(newRawMeterData);
 	BatteryMeter.init();
 	DataLogger.init();
 	ScumDisplay.init();
@@ -88,6 +94,11 @@ void newBatteryMeasurement(const BatteryMeasurement& value) {
 	ScumDisplay.newMeasurement(value);
 	DataLogger.newMeasurement(value);
 	AlarmLog.newMeasurement(value);
+	SerialCommands.newMeasurement(value);
+}
+
+void newRawMeterData(const char* data, uint8_t length) {
+	SerialCommands.newRawData(data, length);
 }
 
 void menuButtonHeld(Button& but) {
@@ -105,9 +116,10 @@ void menuButtonHeld(Button& but) {
 void loop() {
 //	CURRENT_TIME = now();
 
-	DisplayButton.process();
-	MenuButton.process();
-	BatteryMeter.process();
-	ScumDisplay.process();
-	SerialCommands.process();
+	REPLAY_STAGE(ReplayRtc, RtcClock.process());
+	REPLAY_STAGE(ReplayButtons, DisplayButton.process(); MenuButton.process());
+	REPLAY_STAGE(ReplayMeter, BatteryMeter.process());
+	REPLAY_STAGE(ReplayLogger, DataLogger.poll());
+	REPLAY_STAGE(ReplayDisplay, ScumDisplay.process());
+	REPLAY_STAGE(ReplaySerial, SerialCommands.process());
 }
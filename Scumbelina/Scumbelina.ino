@@ -1,7 +1,9 @@
 #include "Configuration.h"
+#include "MemoryMonitor.h"
 #include "AlarmLog.h"
 #include <Wire.h>
 #include <SPI.h>
+#include <SpiBus.h>
 #include <SoftwareSerial.h>
 #include <DS3232RTC.h>
 #include <Time.h>
@@ -9,18 +9,31 @@
 #include "SerialCommands.h"
 #include "ScumDisplay.h"
 #include "Configuration.h"
+#include "RtcClock.h"
+#include "MemoryMonitor.h"
+#ifdef ARDUINO
+#include <SpiBus.h>
+#endif
 
 
 
 CmdMessenger cmdMessenger = CmdMessenger(Serial);
 static const char DEVICE_ID[] PROGMEM = "F21089D968C34F2E97F34FA6EB5AEDCA";
 bool SerialCommandsClass::dumpError = false;
+bool SerialCommandsClass::dumpStalled = false;
+uint16_t SerialCommandsClass::dumpCredit = 0;
+bool SerialCommandsClass::dumpFlowControl = false;
+uint32_t SerialCommandsClass::linkBaud = LINK_DEFAULT_BAUD;
+unsigned long SerialCommandsClass::linkChangeMillis = 0;
+uint8_t SerialCommandsClass::telemetryFlags = 0;
+uint16_t SerialCommandsClass::telemetryInterval = 0;
+unsigned long SerialCommandsClass::telemetryMillis = 0;
+uint16_t SerialCommandsClass::telemetrySequence = 0;
+uint16_t SerialCommandsClass::telemetryRawDropped = 0;
 
 
-// ::TODO::
-// Can save some ram by re-ordering commands
-// with callbacks to the start of the enum.
-// max callbacks is set based on the max command number with a callback.
+// Shared with the host. Only add to the end.
+// Each command needs an entry in commandHandlers.
 enum
 {
 	kIdentify,           // Command to identify device
@@ -33,7 +46,88 @@ enum
 	kDataDownloadComplete, // Command from arduino indicating completion of the data download.
 	kGetConfiguration,	// Get current config parameters
 	kSetConfiguration,	// Set current config parameters
-	kConfigurationData	// Config data.
+	kConfigurationData,	// Config data.
+	kRequestAlarmDownload,	// Command to request the alarm history from arduino
+	kAlarmDownloadItem,	// Command from arduino for an alarm
+	kAlarmDownloadComplete,	// Command from arduino indicating completion of the alarm download.
+	kGetAlarmRule,		// Get an alarm rule
+	kSetAlarmRule,		// Set an alarm rule
+	kAlarmRuleData,		// Alarm rule data.
+	kSyncClock,		// Sync the clock to the host time to the millisecond
+	kClockSyncData,		// Clock error and drift measured by the sync
+	kGetEepromWear,		// Get the configuration write counts
+	kEepromWearData,	// Writes to each configuration slot
+	kSetBaudRate,		// Change the baud rate of the host link
+	kDataDownloadCredit,	// More items the host can take during a download
+	kSubscribeTelemetry,	// Start or stop pushing live data
+	kTelemetryData,		// A new measurement
+	kTelemetryRaw,		// Data received from the meter
+	kGetDiagnostics,	// Get the memory, SD cache, log repair, telemetry and SPI bus stats
+	kDiagnosticsData,	// Memory, SD cache, log repair, telemetry and SPI bus stats
+	kCommandCount
+};
+
+// Indexed by command. NULL for commands that are only sent by the Arduino.
+// Kept in PROGMEM, so only costs flash.
+const messengerCallbackFunction SerialCommandsClass::commandHandlers[] PROGMEM = {
+	OnWatchdogRequest,	// kIdentify
+	NULL,				// kAcknowledge
+	NULL,				// kError
+	OnSetDateTime,		// kSetDateTime
+	OnDataDump,			// kRequestDataDownload
+	NULL,				// kDataDownloadStart
+	NULL,				// kDataDownloadItem
+	NULL,				// kDataDownloadComplete
+	OnGetConfiguration,	// kGetConfiguration
+	OnSetConfiguration,	// kSetConfiguration
+	NULL,				// kConfigurationData
+	OnAlarmDump,		// kRequestAlarmDownload
+	NULL,				// kAlarmDownloadItem
+	NULL,				// kAlarmDownloadComplete
+	OnGetAlarmRule,		// kGetAlarmRule
+	OnSetAlarmRule,		// kSetAlarmRule
+	NULL,				// kAlarmRuleData
+	OnSyncClock,		// kSyncClock
+	NULL,				// kClockSyncData
+	OnGetEepromWear,	// kGetEepromWear
+	NULL,				// kEepromWearData
+	OnSetBaudRate,		// kSetBaudRate
+	OnDataDownloadCredit,	// kDataDownloadCredit
+	OnSubscribeTelemetry,	// kSubscribeTelemetry
+	NULL,				// kTelemetryData
+	NULL,				// kTelemetryRaw
+	OnGetDiagnostics,	// kGetDiagnostics
+	NULL				// kDiagnosticsData
+};
+
+// Attached while a download is running. Commands are read while waiting for
+// credit, but anything else would run in the middle of the dump, and could
+// close the log file or overwrite TMPBUF under it. So everything but credit
+// gets an error.
+const messengerCallbackFunction SerialCommandsClass::dumpHandlers[] PROGMEM = {
+	NULL,				// kIdentify
+	NULL,				// kAcknowledge
+	NULL,				// kError
+	NULL,				// kSetDateTime
+	NULL,				// kRequestDataDownload
+	NULL,				// kDataDownloadStart
+	NULL,				// kDataDownloadItem
+	NULL,				// kDataDownloadComplete
+	NULL,				// kGetConfiguration
+	NULL,				// kSetConfiguration
+	NULL,				// kConfigurationData
+	NULL,				// kRequestAlarmDownload
+	NULL,				// kAlarmDownloadItem
+	NULL,				// kAlarmDownloadComplete
+	NULL,				// kGetAlarmRule
+	NULL,				// kSetAlarmRule
+	NULL,				// kAlarmRuleData
+	NULL,				// kSyncClock
+	NULL,				// kClockSyncData
+	NULL,				// kGetEepromWear
+	NULL,				// kEepromWearData
+	NULL,				// kSetBaudRate
+	OnDataDownloadCredit	// kDataDownloadCredit
 };
 
 
@@ -54,14 +148,206 @@ void SerialCommandsClass::OnSetDateTime() {
 		cmdMessenger.sendCmd(kError);
 	}
 	else {
-		DataLogger.setTime(yyyy, mm, dd, hh, MM, ss);
+		RtcClock.setTime(yyyy, mm, dd, hh, MM, ss);
 		cmdMessenger.sendCmd(kAcknowledge);
 	}
 }
 
+// Args are the host time in seconds and the milliseconds past that second.
+// The sync waits for an RTC edge, so the reply is sent by OnClockSynced.
+void SerialCommandsClass::OnSyncClock() {
+	time_t hostTime = (time_t)cmdMessenger.readInt32Arg();
+	uint16_t hostMs = (uint16_t)cmdMessenger.readInt16Arg();
+	if (hostMs > 999 || !RtcClock.syncToHost(hostTime, hostMs)) {
+		cmdMessenger.sendCmd(kError);
+	}
+}
+
+// Replies with the clock error in ms, the drift in tenths of ppm (0 if not yet known)
+// and the RTC aging offset.
+void SerialCommandsClass::OnClockSynced(int32_t error, int16_t drift) {
+	cmdMessenger.sendCmdStart(kClockSyncData);
+	cmdMessenger.sendCmdArg(error);
+	cmdMessenger.sendCmdArg(drift);
+	cmdMessenger.sendCmdArg((int16_t)RtcClock.getAgingOffset());
+	cmdMessenger.sendCmdEnd();
+}
+
+//
+// Waits until the host has room for another item.
+// UART writes block while the transmit buffer is full, so SD reads are
+// already paced to the link. This paces them to the host as well.
+//
+bool SerialCommandsClass::waitForDumpCredit() {
+	if (!dumpFlowControl) {
+		return true;
+	}
+	unsigned long start = millis();
+	while (dumpCredit == 0 && !dumpStalled) {
+		cmdMessenger.feedinSerialData();
+		if (millis() - start > DUMP_CREDIT_TIMEOUT) {
+			// Drop the rest of the dump rather than hang.
+			dumpStalled = true;
+		}
+	}
+	if (dumpStalled) {
+		return false;
+	}
+	dumpCredit--;
+	return true;
+}
+
+void SerialCommandsClass::OnDataDownloadCredit() {
+	uint16_t credit = (uint16_t)cmdMessenger.readInt16Arg();
+	dumpCredit = credit > 0xFFFF - dumpCredit ? 0xFFFF : dumpCredit + credit;
+}
+
+bool SerialCommandsClass::isSupportedBaud(uint32_t baud) {
+	// The faster rates divide 16MHz exactly with the UART in double speed mode.
+	return baud == 115200UL || baud == 250000UL || baud == 500000UL || baud == 1000000UL;
+}
+
+//
+// Changes the baud rate in two steps. The new rate is acknowledged at the old
+// rate, then the host must send the same command at the new rate to confirm it.
+// If it doesn't within LINK_CONFIRM_TIMEOUT, process() goes back to the default
+// so a host that couldn't follow can still connect.
+//
+void SerialCommandsClass::OnSetBaudRate() {
+	uint32_t baud = (uint32_t)cmdMessenger.readInt32Arg();
+	if (!isSupportedBaud(baud)) {
+		cmdMessenger.sendCmd(kError);
+		return;
+	}
+	cmdMessenger.sendCmdStart(kAcknowledge);
+	cmdMessenger.sendCmdArg(baud);
+	cmdMessenger.sendCmdEnd();
+	if (baud == linkBaud) {
+		linkChangeMillis = 0;
+		return;
+	}
+	Serial.flush();	// Finish sending the acknowledge at the old rate.
+	Serial.begin(baud);
+	linkBaud = baud;
+	linkChangeMillis = millis() | 1;	// Never 0
+}
+
+//
+// Subscribes to live data. The flags say what to push (0 stops it),
+// and the interval is the minimum ms between measurement frames.
+//
+void SerialCommandsClass::OnSubscribeTelemetry() {
+	uint8_t flags = (uint8_t)cmdMessenger.readInt16Arg();
+	uint16_t interval = (uint16_t)cmdMessenger.readInt16Arg();
+	if (flags & ~(TELEMETRY_MEASUREMENTS | TELEMETRY_RAW)) {
+		cmdMessenger.sendCmd(kError);
+		return;
+	}
+	telemetryFlags = flags;
+	telemetryInterval = interval;
+	telemetryMillis = millis() - interval;	// Send the next measurement
+	telemetrySequence = 0;
+	cmdMessenger.sendCmd(kAcknowledge);
+}
+
+//
+// True if a command with a binary payload of length bytes can be sent
+// without waiting for the UART. Allows for every byte being escaped, which
+// binary data full of 0s, separators and escapes can need.
+// Telemetry is dropped rather than holding up the meter when the host is slow.
+//
+bool SerialCommandsClass::hasRoomFor(uint8_t length) {
+#ifdef ARDUINO
+	return Serial.availableForWrite() >= 2 * length + TELEMETRY_OVERHEAD;
+#else
+	return true;
+#endif
+}
+
+void SerialCommandsClass::newMeasurement(const BatteryMeasurement& value) {
+	if (!(telemetryFlags & TELEMETRY_MEASUREMENTS) ||
+		millis() - telemetryMillis < telemetryInterval) {
+		return;
+	}
+	telemetryMillis = millis();
+	TelemetryFrame frame;
+	frame.sequence = telemetrySequence++;
+	if (!hasRoomFor(sizeof(frame))) {
+		return;
+	}
+	frame.timestamp = value.timestamp;
+	frame.timestampMs = value.timestampMs;
+	frame.volts = value.volts.toHundredths();
+	frame.amps = value.amps.toHundredths();
+	frame.power = value.power.toHundredths();
+	cmdMessenger.sendCmdStart(kTelemetryData);
+	cmdMessenger.sendCmdBinArg(&frame, sizeof(frame));
+	cmdMessenger.sendCmdEnd();
+}
+
+// Split into chunks that can always fit the UART buffer. Dropped chunks are
+// counted for the diagnostics.
+void SerialCommandsClass::newRawData(const char* data, uint8_t length) {
+	if (!(telemetryFlags & TELEMETRY_RAW)) {
+		return;
+	}
+	while (length > 0) {
+		uint8_t n = length < TELEMETRY_RAW_CHUNK ? length : TELEMETRY_RAW_CHUNK;
+		if (hasRoomFor(n)) {
+			cmdMessenger.sendCmdStart(kTelemetryRaw);
+			cmdMessenger.sendCmdBinArg(data, n);
+			cmdMessenger.sendCmdEnd();
+		}
+		else {
+			telemetryRawDropped++;
+		}
+		data += n;
+		length -= n;
+	}
+}
+
+void SerialCommandsClass::OnGetDiagnostics() {
+	cmdMessenger.sendCmdStart(kDiagnosticsData);
+	cmdMessenger.sendCmdArg(MemoryMonitor.freeRam());
+	cmdMessenger.sendCmdArg(MemoryMonitor.stackHeadroom());
+	cmdMessenger.sendCmdArg(MemoryMonitor.staticRam());
+	cmdMessenger.sendCmdArg((uint16_t)MemoryMonitor.tmpbufHighWater());
+	cmdMessenger.sendCmdArg((uint16_t)sizeof(TMPBUF));
+	cmdMessenger.sendCmdArg(DataLogger.getCacheHits());
+	cmdMessenger.sendCmdArg(DataLogger.getCacheMisses());
+	cmdMessenger.sendCmdArg(DataLogger.getTornBytes());
+	cmdMessenger.sendCmdArg(DataLogger.getFreedClusters());
+	cmdMessenger.sendCmdArg(DataLogger.getSkippedRecords());
+	cmdMessenger.sendCmdArg(telemetryRawDropped);
+#ifdef ARDUINO
+	// Then the chip select pin, selects and busy ms of each SPI device
+	cmdMessenger.sendCmdArg(SpiBus.getSwitches());
+	for (SpiBusClass::Device* device = SpiBus.getDevices(); device; device = device->next) {
+		cmdMessenger.sendCmdArg(device->csPin);
+		cmdMessenger.sendCmdArg(device->selects);
+		cmdMessenger.sendCmdArg(device->busyMicros / 1000);
+	}
+#else
+	cmdMessenger.sendCmdArg(0);
+#endif
+	cmdMessenger.sendCmdEnd();
+}
+
+// Sends the number of writes to each configuration slot,
+// so the host can estimate how much EEPROM life is left.
+void SerialCommandsClass::OnGetEepromWear() {
+	cmdMessenger.sendCmdStart(kEepromWearData);
+	for (uint8_t i = 0; i < Configuration.getSlotCount(); i++) {
+		cmdMessenger.sendCmdArg(Configuration.getSlotWrites(i));
+	}
+	cmdMessenger.sendCmdEnd();
+}
 
 void SerialCommandsClass::OnNewDataItem(char** values, int8_t numValues, int8_t error) {
 	if (error == 0) {
+		if (!waitForDumpCredit()) {
+			return;
+		}
 		cmdMessenger.sendCmdStart(kDataDownloadItem);
 		for (int i = 0; i < numValues; i++) {
 			cmdMessenger.sendCmdArg(values[i]);
@@ -77,15 +363,23 @@ void SerialCommandsClass::OnDataDump()
 {
 	uint32_t startDate = cmdMessenger.readInt32Arg();
 	uint32_t endDate = cmdMessenger.readInt32Arg();
+	// Items the host can buffer. Older hosts don't send it, so don't flow control the dump.
+	uint16_t window = (uint16_t)cmdMessenger.readInt16Arg();
 
 	cmdMessenger.sendCmd(kDataDownloadStart);
-	cmdMessenger.feedinSerialData();
 
+	// Only credit is handled until the dump is over. See dumpHandlers.
+	cmdMessenger.attach(dumpHandlers, sizeof(dumpHandlers) / sizeof(dumpHandlers[0]));
 	dumpError = false;
+	dumpStalled = false;
+	dumpCredit = window;
+	dumpFlowControl = window != 0;
+	cmdMessenger.feedinSerialData();
 
 	DataLogger.dumpTo(startDate, endDate, OnNewDataItem);
+	cmdMessenger.attach(commandHandlers, kCommandCount);
 
-	if (dumpError == 0) {
+	if (dumpError == 0 && !dumpStalled) {
 		cmdMessenger.sendCmd(kDataDownloadComplete);
 	}
 	else {
@@ -93,29 +387,87 @@ void SerialCommandsClass::OnDataDump()
 	}
 }
 
+void SerialCommandsClass::OnNewAlarmItem(const Alarm& alarm, uint16_t position) {
+	cmdMessenger.sendCmdStart(kAlarmDownloadItem);
+	cmdMessenger.sendCmdArg(alarm.timestamp);
+	TMPBUF_ACQUIRE;
+	AlarmLog.formatAlarm(TMPBUF, alarm);
+	cmdMessenger.sendCmdArg(TMPBUF);
+	TMPBUF_RELEASE;
+	cmdMessenger.sendCmdEnd();
+}
+
+// Sends the whole alarm journal, most recent first.
+void SerialCommandsClass::OnAlarmDump()
+{
+	cmdMessenger.sendCmd(kDataDownloadStart);
+	DataLogger.dumpAlarms(0, ALARM_JOURNAL_RECORDS, OnNewAlarmItem);
+	cmdMessenger.sendCmd(kAlarmDownloadComplete);
+}
+
+// The whole configuration is sent as a single binary argument.
+// See ConfigurationClass::Blob
 void SerialCommandsClass::OnGetConfiguration() {
-	ConfigurationClass::Config& values = Configuration.getConfig();
+	ConfigurationClass::Blob blob;
+	Configuration.toBlob(blob);
 
 	cmdMessenger.sendCmdStart(kConfigurationData);
-	cmdMessenger.sendCmdArg((uint16_t)(values.screenSaverTimeout / 1000UL));
-	cmdMessenger.sendCmdArg((uint16_t)(values.meterPollFrequency / 1000UL));
-	cmdMessenger.sendCmdArg((uint16_t)(values.loggingFrequency / 1000UL));
-	cmdMessenger.sendCmdArg(values.maxVolts);
-	cmdMessenger.sendCmdArg(values.minVolts);
-	cmdMessenger.sendCmdArg(values.maxAmps);
+	cmdMessenger.sendCmdBinArg(&blob, sizeof(blob));
 	cmdMessenger.sendCmdEnd();
 }
 
+// Accepts a blob of any older CONFIG_VERSION as well.
+// The configuration is only changed if the whole blob is valid.
 void SerialCommandsClass::OnSetConfiguration() {
-	ConfigurationClass::Config& values = Configuration.getConfig();
-	values.screenSaverTimeout = (uint32_t)cmdMessenger.readInt32Arg() * 1000UL;
-	values.meterPollFrequency = (uint32_t)cmdMessenger.readInt32Arg() * 1000UL;
-	values.loggingFrequency = (uint32_t)cmdMessenger.readInt32Arg() * 1000UL;
-	strlcpy(values.maxVolts, cmdMessenger.readStringArg(), sizeof(values.maxVolts));
-	strlcpy(values.minVolts, cmdMessenger.readStringArg(), sizeof(values.maxVolts));
-	strlcpy(values.maxAmps, cmdMessenger.readStringArg(), sizeof(values.maxVolts));
-
-	// No validation on these values.. Be careful!!
+	ConfigurationClass::Blob blob;
+	uint8_t length = cmdMessenger.readBinArg(&blob, sizeof(blob));
+
+	if (length < sizeof(blob.header) ||
+		length != sizeof(blob.header) + blob.header.size ||
+		!Configuration.fromBlob(blob)) {
+		cmdMessenger.sendCmd(kError);
+		return;
+	}
+	cmdMessenger.sendCmd(kAcknowledge);
+}
+
+// Args are the rule index, then the fields of the rule. See ConfigurationClass::AlarmRule
+void SerialCommandsClass::OnGetAlarmRule() {
+	uint8_t index = (uint8_t)cmdMessenger.readInt16Arg();
+	if (index >= MAX_ALARM_RULES) {
+		cmdMessenger.sendCmd(kError);
+		return;
+	}
+	const ConfigurationClass::AlarmRule& rule = Configuration.getConfig().alarmRules[index];
+
+	cmdMessenger.sendCmdStart(kAlarmRuleData);
+	cmdMessenger.sendCmdArg(index);
+	cmdMessenger.sendCmdArg(rule.type);
+	cmdMessenger.sendCmdArg(rule.threshold);
+	cmdMessenger.sendCmdArg(rule.hysteresis);
+	cmdMessenger.sendCmdArg(rule.duration);
+	cmdMessenger.sendCmdArg(rule.rateLimit);
+	cmdMessenger.sendCmdEnd();
+}
+
+void SerialCommandsClass::OnSetAlarmRule() {
+	uint8_t index = (uint8_t)cmdMessenger.readInt16Arg();
+	if (index >= MAX_ALARM_RULES) {
+		cmdMessenger.sendCmd(kError);
+		return;
+	}
+	ConfigurationClass::AlarmRule rule;
+	rule.type = (uint8_t)cmdMessenger.readInt16Arg();
+	rule.threshold = cmdMessenger.readInt16Arg();
+	rule.hysteresis = (uint8_t)cmdMessenger.readInt16Arg();
+	rule.duration = (uint8_t)cmdMessenger.readInt16Arg();
+	rule.rateLimit = (uint8_t)cmdMessenger.readInt16Arg();
+	if (!ConfigurationClass::isValidRule(rule)) {
+		cmdMessenger.sendCmd(kError);
+		return;
+	}
+
+	Configuration.getConfig().alarmRules[index] = rule;
 	Configuration.saveConfig();
 	cmdMessenger.sendCmd(kAcknowledge);
 }
@@ -137,12 +489,12 @@ void SerialCommandsClass::OnWatchdogRequest()
 void SerialCommandsClass::attachCommandCallbacks()
 {
 	// Attach callback methods
+	// Fails to compile if a command has been added without a handler entry.
+	typedef char commandHandlersCheck[(sizeof(commandHandlers) / sizeof(commandHandlers[0]) == kCommandCount) ? 1 : -1];
+	(void)sizeof(commandHandlersCheck);
+
 	cmdMessenger.attach(OnUnknownCommand);
-	cmdMessenger.attach(kIdentify, OnWatchdogRequest);
-	cmdMessenger.attach(kSetDateTime, OnSetDateTime);
-	cmdMessenger.attach(kRequestDataDownload, OnDataDump);
-	cmdMessenger.attach(kGetConfiguration, OnGetConfiguration);
-	cmdMessenger.attach(kSetConfiguration, OnSetConfiguration);
+	cmdMessenger.attach(commandHandlers, kCommandCount);
 }
 
 
@@ -152,8 +504,14 @@ void SerialCommandsClass::init()
 
 	// Attach my application's user-defined callback methods
 	attachCommandCallbacks();
+	RtcClock.syncHandler(OnClockSynced);
 }
 
 void SerialCommandsClass::process() {
 	cmdMessenger.feedinSerialData();
+	if (linkChangeMillis != 0 && millis() - linkChangeMillis > LINK_CONFIRM_TIMEOUT) {
+		Serial.begin(LINK_DEFAULT_BAUD);
+		linkBaud = LINK_DEFAULT_BAUD;
+		linkChangeMillis = 0;
+	}
 }
\ No newline at end of file
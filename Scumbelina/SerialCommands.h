@@ -3,11 +3,40 @@
 #ifndef _SERIALCOMMANDS_h
 #define _SERIALCOMMANDS_h
 #include<CmdMessenger.h>
+#include "AlarmLog.h"
+#include "BatteryMeter.h"
+
+// Baud rate at power up, and after a failed baud rate change.
+#define LINK_DEFAULT_BAUD 115200UL
+// Time for the host to confirm a new baud rate before the default is restored.
+#define LINK_CONFIRM_TIMEOUT 2000
+// Longest wait for the host to grant more credit during a download before it is abandoned.
+#define DUMP_CREDIT_TIMEOUT 5000
+// Telemetry subscription flags
+#define TELEMETRY_MEASUREMENTS 0x01	// Push each new measurement
+#define TELEMETRY_RAW 0x02			// Push the meter data as it is received
+// Bytes a telemetry command adds to its payload: the command id, separators and line end.
+#define TELEMETRY_OVERHEAD 7
+// Largest raw chunk sent in one command. Even with every byte escaped,
+// the command still fits the 64 byte UART transmit buffer.
+#define TELEMETRY_RAW_CHUNK 28
 
 class SerialCommandsClass
 {
 private:
 	static bool dumpError;
+	static bool dumpStalled;	// The host stopped granting credit.
+	static uint16_t dumpCredit;	// Items that can be sent before waiting for more.
+	static bool dumpFlowControl;
+	static uint32_t linkBaud;
+	static unsigned long linkChangeMillis;	// When the baud rate was changed. 0 once confirmed.
+	static uint8_t telemetryFlags;
+	static uint16_t telemetryInterval;		// Minimum ms between measurement frames
+	static unsigned long telemetryMillis;	// When the last measurement frame was due
+	static uint16_t telemetrySequence;
+	static uint16_t telemetryRawDropped;	// Raw chunks dropped for want of room
+	static const messengerCallbackFunction commandHandlers[];
+	static const messengerCallbackFunction dumpHandlers[];
 
  protected:
 
@@ -19,13 +48,41 @@ private:
 	 static void OnGetConfiguration();
 	 static void OnSetConfiguration();
 	 static void OnWatchdogRequest();
+	 static void OnAlarmDump();
+	 static void OnGetAlarmRule();
+	 static void OnSetAlarmRule();
+	 static void OnSyncClock();
+	 static void OnClockSynced(int32_t error, int16_t drift);
+	 static void OnGetEepromWear();
+	 static void OnSetBaudRate();
+	 static void OnDataDownloadCredit();
+	 static bool isSupportedBaud(uint32_t baud);
+	 static bool waitForDumpCredit();
+	 static void OnSubscribeTelemetry();
+	 static void OnGetDiagnostics();
+	 static bool hasRoomFor(uint8_t length);
 	 
 
 	 static void OnNewDataItem(char** values, int8_t numValues, int8_t error);
+	 static void OnNewAlarmItem(const Alarm& alarm, uint16_t position);
 
  public:
+	// Measurement pushed to the host. Packed so it is the same on the host.
+#pragma pack(push, 1)
+	struct TelemetryFrame {
+		uint16_t sequence;	// Counts frames that were due, so dropped frames show up as gaps.
+		uint32_t timestamp;
+		uint16_t timestampMs;
+		int16_t volts;		// Hundredths, -1 if not read
+		int16_t amps;
+		int16_t power;
+	};
+#pragma pack(pop)
+
 	void init();
 	void process();
+	void newMeasurement(const BatteryMeasurement& value);
+	void newRawData(const char* data, uint8_t length);
 };
 
 #endif
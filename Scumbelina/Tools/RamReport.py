@@ -0,0 +1,52 @@
+"""Static RAM used by each module of a build.
+
+Sums the .data and .bss symbols of each object file, so the cost of each
+module's buffers and globals can be seen, and compared between builds.
+
+Usage: python RamReport.py <build folder> [avr-nm]
+The build folder is the one holding the .o files, e.g. the Visual Micro or
+Arduino IDE temporary build folder. avr-nm must be on the path if not given.
+"""
+import os
+import subprocess
+import sys
+
+
+def module_ram(nm, path):
+	data = bss = 0
+	output = subprocess.check_output([nm, "--size-sort", "-S", path]).decode()
+	for line in output.splitlines():
+		fields = line.split()
+		if len(fields) < 4:
+			continue
+		size = int(fields[1], 16)
+		kind = fields[2].lower()
+		if kind == "d":
+			data += size
+		elif kind == "b":
+			bss += size
+	return data, bss
+
+
+def main():
+	if len(sys.argv) < 2:
+		print(__doc__)
+		sys.exit(1)
+	folder = sys.argv[1]
+	nm = sys.argv[2] if len(sys.argv) > 2 else "avr-nm"
+	rows = []
+	for root, dirs, files in os.walk(folder):
+		for name in files:
+			if name.endswith(".o"):
+				data, bss = module_ram(nm, os.path.join(root, name))
+				if data or bss:
+					rows.append((data + bss, data, bss, name))
+	rows.sort(reverse=True)
+	print("%6s %6s %6s  %s" % ("Total", ".data", ".bss", "Module"))
+	for total, data, bss, name in rows:
+		print("%6d %6d %6d  %s" % (total, data, bss, name))
+	print("%6d %6d %6d  All modules" % (sum(r[0] for r in rows), sum(r[1] for r in rows), sum(r[2] for r in rows)))
+
+
+if __name__ == "__main__":
+	main()
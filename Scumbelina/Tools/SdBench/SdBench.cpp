@@ -0,0 +1,434 @@
+//
+// Host benchmark for the SdFat code the data logger uses.
+//
+// Runs the real FatVolume, FatFile and FatCache code over FAT16 and FAT32 images
+// in files, and counts the block reads and writes and the block cache hits and
+// misses for each operation: mount, free space, open, append, flush, seek,
+// dump scan, month rollover and allocation on a full card. The images vary in
+// size, cluster size and how fragmented the free space is, so a change to the
+// storage code can be judged by its block I/O. Build it with
+// different SdFat options to compare, e.g.
+//
+//   g++ -O2 -I../../../libraries/SdFat/utility -DUSE_FREE_CLUSTER_SUMMARY=1 -DFAT_CACHE_SLOTS=3
+//       SdBench.cpp ../../../libraries/SdFat/utility/Fat*.cpp
+//       ../../../libraries/SdFat/utility/FmtNumber.cpp -o SdBench
+//
+// Usage: SdBench [image folder]
+// The images are sparse, so an 8GB image only takes a few MB of disk.
+//
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include "FatFileSystem.h"
+
+#ifdef _WIN32
+#define fseeko _fseeki64
+typedef __int64 off_t;
+#endif
+
+#define BLOCK_SIZE 512
+#define FAT32_RESERVED_BLOCKS 32
+#define FAT16_RESERVED_BLOCKS 1
+#define FAT16_ROOT_ENTRIES 512
+#define FSINFO_BLOCK 1
+#define ROOT_CLUSTER 2
+// Lines in the month file that is opened, seeked and scanned.
+#define APPEND_LINES 1000
+#define LOG_LINES 500
+#define SEEKS 100
+#define STR_(x) #x
+#define STR(x) STR_(x)
+
+//
+// A FAT volume in an image file, counting the block I/O.
+//
+class ImageVolume : public FatFileSystem
+{
+protected:
+	FILE* image = 0;
+	uint32_t fatStart = 0;
+	uint32_t fatEnd = 0;
+
+	bool seek(uint32_t block) {
+		return fseeko(image, (off_t)block * BLOCK_SIZE, SEEK_SET) == 0;
+	}
+	bool readBlock(uint32_t block, uint8_t* dst) {
+		if (block >= fatStart && block < fatEnd) {
+			fatReads++;
+		}
+		else {
+			dataReads++;
+		}
+		return seek(block) && fread(dst, BLOCK_SIZE, 1, image) == 1;
+	}
+	bool writeBlock(uint32_t block, const uint8_t* src) {
+		writes++;
+		return seek(block) && fwrite(src, BLOCK_SIZE, 1, image) == 1;
+	}
+#if USE_MULTI_BLOCK_IO
+	bool readBlocks(uint32_t block, uint8_t* dst, size_t nb) {
+		for (size_t i = 0; i < nb; i++) {
+			if (!readBlock(block + i, dst + i * BLOCK_SIZE)) {
+				return false;
+			}
+		}
+		return true;
+	}
+	bool writeBlocks(uint32_t block, const uint8_t* src, size_t nb) {
+		for (size_t i = 0; i < nb; i++) {
+			if (!writeBlock(block + i, src + i * BLOCK_SIZE)) {
+				return false;
+			}
+		}
+		return true;
+	}
+#endif
+public:
+	uint32_t fatReads = 0;
+	uint32_t dataReads = 0;
+	uint32_t writes = 0;
+
+	~ImageVolume() {
+		close();
+	}
+	bool open(const char* path) {
+		close();
+		image = fopen(path, "r+b");
+		if (!image || !begin(0)) {
+			return false;
+		}
+		fatStart = fatStartBlock();
+		fatEnd = fatStart + 2 * blocksPerFat();
+		return true;
+	}
+	void close() {
+		if (image) {
+			fclose(image);
+			image = 0;
+		}
+	}
+	void resetCounts() {
+		fatReads = dataReads = writes = 0;
+	}
+};
+
+//
+// A test volume. Images are built with all but freeClusters allocated.
+// freeRun is 0 to put the free clusters all at the end, as on a card filled
+// in order. Otherwise they are spread evenly over the volume in runs of
+// freeRun clusters, so 1 is the most fragmented.
+// knownFree sets the FAT32 FSINFO free count, otherwise it is left unknown as
+// when the card was last written by something that doesn't keep it. SdFat
+// only takes the count as a hint, so it should make no difference.
+//
+struct Scenario {
+	uint8_t fatType;
+	uint32_t megabytes;
+	uint8_t blocksPerCluster;
+	uint32_t freeClusters;
+	uint16_t freeRun;
+	bool knownFree;
+};
+
+static bool makeImage(const char* path, const Scenario& sc) {
+	bool fat32 = sc.fatType == 32;
+	uint32_t totalBlocks = sc.megabytes * 2048;
+	uint32_t reservedBlocks = fat32 ? FAT32_RESERVED_BLOCKS : FAT16_RESERVED_BLOCKS;
+	uint32_t rootBlocks = fat32 ? 0 : FAT16_ROOT_ENTRIES * 32 / BLOCK_SIZE;
+	uint16_t entriesPerBlock = fat32 ? 128 : 256;
+	// FAT size, allowing for the FATs themselves.
+	uint32_t clusters = (totalBlocks - reservedBlocks - rootBlocks) / sc.blocksPerCluster;
+	uint32_t blocksPerFat = (clusters + 2 + entriesPerBlock - 1) / entriesPerBlock;
+	clusters = (totalBlocks - reservedBlocks - rootBlocks - 2 * blocksPerFat) / sc.blocksPerCluster;
+	uint32_t lastCluster = clusters + 1;
+	if (fat32 ? clusters < 65525 : clusters < 4085 || clusters >= 65525) {
+		return false;
+	}
+
+	FILE* image = fopen(path, "w+b");
+	if (!image) {
+		return false;
+	}
+	cache_t block;
+	memset(&block, 0, sizeof(block));
+	// The FAT16 and FAT32 boot sectors share the fields up to the FAT size.
+	fat_boot_t& bs = block.fbs;
+	bs.jump[0] = 0xEB;
+	bs.jump[1] = fat32 ? 0x58 : 0x3C;
+	bs.jump[2] = 0x90;
+	memcpy(bs.oemId, "SCUMBENC", 8);
+	bs.bytesPerSector = BLOCK_SIZE;
+	bs.sectorsPerCluster = sc.blocksPerCluster;
+	bs.reservedSectorCount = reservedBlocks;
+	bs.fatCount = 2;
+	bs.rootDirEntryCount = fat32 ? 0 : FAT16_ROOT_ENTRIES;
+	bs.mediaType = 0xF8;
+	if (totalBlocks < 0x10000 && !fat32) {
+		bs.totalSectors16 = totalBlocks;
+	}
+	else {
+		bs.totalSectors32 = totalBlocks;
+	}
+	if (fat32) {
+		fat32_boot_t& fbs = block.fbs32;
+		fbs.sectorsPerFat32 = blocksPerFat;
+		fbs.fat32RootCluster = ROOT_CLUSTER;
+		fbs.fat32FSInfo = FSINFO_BLOCK;
+		fbs.bootSignature = EXTENDED_BOOT_SIG;
+		memcpy(fbs.fileSystemType, "FAT32   ", 8);
+		fbs.bootSectorSig0 = BOOTSIG0;
+		fbs.bootSectorSig1 = BOOTSIG1;
+	}
+	else {
+		bs.sectorsPerFat16 = blocksPerFat;
+		bs.bootSignature = EXTENDED_BOOT_SIG;
+		memcpy(bs.fileSystemType, "FAT16   ", 8);
+		bs.bootSectorSig0 = BOOTSIG0;
+		bs.bootSectorSig1 = BOOTSIG1;
+	}
+	fwrite(&block, BLOCK_SIZE, 1, image);
+
+	if (fat32) {
+		memset(&block, 0, sizeof(block));
+		block.fsinfo.leadSignature = FSINFO_LEAD_SIG;
+		block.fsinfo.structSignature = FSINFO_STRUCT_SIG;
+		block.fsinfo.freeCount = sc.knownFree ? sc.freeClusters : 0xFFFFFFFF;
+		block.fsinfo.nextFree = 0xFFFFFFFF;
+		block.fsinfo.tailSignature[2] = 0x55;
+		block.fsinfo.tailSignature[3] = 0xAA;
+		fwrite(&block, BLOCK_SIZE, 1, image);
+	}
+
+	// Every cluster is its own one cluster file, except the free ones.
+	// The FAT32 root directory is in cluster 2, so data clusters start at 3.
+	uint32_t runs = sc.freeRun ? (sc.freeClusters + sc.freeRun - 1) / sc.freeRun : 0;
+	uint32_t runEvery = runs ? (clusters - 1) / runs : 0;
+	uint32_t firstEndFree = lastCluster - sc.freeClusters + 1;
+	uint32_t freed = 0;
+	for (uint32_t fatBlock = 0; fatBlock < blocksPerFat; fatBlock++) {
+		for (uint16_t i = 0; i < entriesPerBlock; i++) {
+			uint32_t cluster = fatBlock * entriesPerBlock + i;
+			bool isFree = false;
+			if (cluster > ROOT_CLUSTER && cluster <= lastCluster && freed < sc.freeClusters) {
+				isFree = sc.freeRun ? runEvery && (cluster - ROOT_CLUSTER - 1) % runEvery < sc.freeRun :
+					cluster >= firstEndFree;
+			}
+			if (isFree) {
+				freed++;
+			}
+			if (fat32) {
+				block.fat32[i] = cluster == 0 ? 0x0FFFFFF8 :
+					cluster > lastCluster || isFree ? 0 : FAT32EOC;
+			}
+			else {
+				block.fat16[i] = cluster == 0 ? 0xFFF8 :
+					cluster > lastCluster || isFree ? 0 : FAT16EOC;
+			}
+		}
+		for (uint8_t fat = 0; fat < 2; fat++) {
+			fseeko(image, (off_t)(reservedBlocks + fat * blocksPerFat + fatBlock) * BLOCK_SIZE, SEEK_SET);
+			fwrite(&block, BLOCK_SIZE, 1, image);
+		}
+	}
+	// Empty root directory, and the size of the image.
+	memset(&block, 0, sizeof(block));
+	uint32_t rootBlock = reservedBlocks + 2 * blocksPerFat;
+	for (uint32_t i = 0; i < (fat32 ? sc.blocksPerCluster : rootBlocks); i++) {
+		fseeko(image, (off_t)(rootBlock + i) * BLOCK_SIZE, SEEK_SET);
+		fwrite(&block, BLOCK_SIZE, 1, image);
+	}
+	fseeko(image, (off_t)(totalBlocks - 1) * BLOCK_SIZE, SEEK_SET);
+	fwrite(&block, BLOCK_SIZE, 1, image);
+	return fclose(image) == 0;
+}
+
+static ImageVolume volume;
+static std::chrono::steady_clock::time_point startTime;
+
+static void start() {
+	volume.resetCounts();
+	volume.cacheResetStats();
+	startTime = std::chrono::steady_clock::now();
+}
+
+static void report(const char* operation) {
+	double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startTime).count();
+	printf("  %-30s %8u %8u %8u %8u %8u %10.2f\n", operation, volume.fatReads, volume.dataReads, volume.writes,
+		volume.cacheHits(), volume.cacheMisses(), ms);
+}
+
+// Creates a file and writes a cluster and a bit, to allocate two clusters.
+static bool newFile(const char* name) {
+	static uint8_t data[BLOCK_SIZE];
+	FatFile file;
+	if (!file.open(volume.vwd(), name, O_RDWR | O_CREAT | O_TRUNC)) {
+		return false;
+	}
+	uint32_t blocks = volume.blocksPerCluster() + 1;
+	for (uint32_t i = 0; i < blocks; i++) {
+		if (file.write(data, sizeof(data)) != sizeof(data)) {
+			file.close();
+			return false;
+		}
+	}
+	return file.close();
+}
+
+static const char csvLine[] = "1420070400,12.34,-1.23,-15.18,250\r\n";
+#define CSV_LINE_LENGTH (sizeof(csvLine) - 1)
+
+// Appends CSV lines to a file, flushing each one when flush is set as the data logger does.
+static bool appendLines(FatFile& file, uint16_t lines, bool flush) {
+	for (uint16_t i = 0; i < lines; i++) {
+		if (file.write(csvLine, CSV_LINE_LENGTH) != CSV_LINE_LENGTH || (flush && !file.sync())) {
+			return false;
+		}
+	}
+	return true;
+}
+
+// Seeks to pseudo random line starts, the same ones every run.
+static bool seekLines(FatFile& file, uint16_t seeks) {
+	uint32_t lines = file.fileSize() / CSV_LINE_LENGTH;
+	uint32_t random = 12345;
+	for (uint16_t i = 0; i < seeks; i++) {
+		random = random * 1103515245 + 12345;
+		if (!file.seekSet((random >> 8) % lines * CSV_LINE_LENGTH)) {
+			return false;
+		}
+	}
+	return true;
+}
+
+// Reads the whole file a line at a time, as a dump does.
+static uint32_t scanLines(FatFile& file) {
+	char line[CSV_LINE_LENGTH];
+	uint32_t lines = 0;
+	file.seekSet(0);
+	while (file.read(line, sizeof(line)) == sizeof(line)) {
+		lines++;
+	}
+	return lines;
+}
+
+static void runScenario(const char* path, const Scenario& sc) {
+	if (!makeImage(path, sc)) {
+		printf("Can't make %s\n", path);
+		return;
+	}
+	printf("\n%uMB FAT%u, %.1fK clusters, %u free ", sc.megabytes, sc.fatType,
+		sc.blocksPerCluster / 2.0, sc.freeClusters);
+	if (sc.freeRun == 0) {
+		printf("at the end");
+	}
+	else {
+		printf("spread out in runs of %u", sc.freeRun);
+	}
+	if (sc.fatType == 32) {
+		printf(", FSINFO free count %s", sc.knownFree ? "known" : "unknown");
+	}
+	printf("\n  %-30s %8s %8s %8s %8s %8s %10s\n", "Operation", "FAT rd", "Data rd", "Writes", "Hits", "Misses", "ms");
+
+	start();
+	if (!volume.open(path)) {
+		printf("Can't mount %s\n", path);
+		return;
+	}
+	report("Mount");
+
+	start();
+	int32_t free = volume.freeClusterCount();
+	report("Free space");
+	start();
+	volume.freeClusterCount();
+	report("Free space again");
+
+	char name[20];
+	bool ok;
+	for (uint8_t month = 1; month <= 3; month++) {
+		sprintf(name, "2015%02u.CSV", month);
+		start();
+		ok = newFile(name);
+		report(ok ? "Month rollover" : "Month rollover (full)");
+	}
+
+	FatFile file;
+	start();
+	ok = file.open(volume.vwd(), "201503.CSV", O_RDWR | O_AT_END) && appendLines(file, APPEND_LINES, false);
+	report(ok ? "Append " STR(APPEND_LINES) " lines" : "Append " STR(APPEND_LINES) " lines (full)");
+	start();
+	ok = file.sync();
+	report(ok ? "Flush" : "Flush (fails)");
+	start();
+	ok = appendLines(file, LOG_LINES, true);
+	report(ok ? "Append+flush " STR(LOG_LINES) " lines" : "Append+flush " STR(LOG_LINES) " lines (full)");
+	file.close();
+
+	volume.close();
+	start();
+	volume.open(path);
+	report("Remount");
+	start();
+	ok = file.open(volume.vwd(), "201503.CSV", O_READ);
+	report(ok ? "Open month file" : "Open month file (fails)");
+	file.close();
+	start();
+	ok = file.open(volume.vwd(), "201503.CSV", O_READ);
+	report(ok ? "Open month file again" : "Open month file again (fails)");
+	start();
+	ok = seekLines(file, SEEKS);
+	report(ok ? "Seek " STR(SEEKS) " lines" : "Seek " STR(SEEKS) " lines (fails)");
+	start();
+	uint32_t lines = scanLines(file);
+	report("Dump scan");
+	file.close();
+	start();
+	ok = newFile("201504.CSV");
+	report(ok ? "Rollover after remount" : "Rollover after remount (full)");
+
+	// Use up the rest of the card.
+	start();
+	uint32_t files = 0;
+	while (files < sc.freeClusters) {
+		sprintf(name, "FILL%04u.BIN", files);
+		if (!newFile(name)) {
+			break;
+		}
+		files++;
+	}
+	report("Fill the card");
+	start();
+	ok = newFile("FULL.CSV");
+	report(ok ? "Allocate on full card" : "Allocate on full card (fails)");
+	start();
+	int32_t left = volume.freeClusterCount();
+	report("Free space when full");
+	printf("  Free clusters at start %d, at end %d. %u lines scanned\n", free, left, lines);
+	volume.close();
+}
+
+// Cluster sizes as chosen by SD Formatter, apart from the fragmented ones.
+static const Scenario scenarios[] = {
+	{ 16, 64, 4, 256, 0, false },
+	{ 16, 64, 4, 256, 1, false },
+	{ 16, 256, 16, 128, 0, false },
+	{ 32, 1024, 8, 64, 0, false },
+	{ 32, 1024, 8, 256, 4, true },
+	{ 32, 8192, 64, 64, 0, false },
+	{ 32, 8192, 64, 64, 0, true },
+	{ 32, 8192, 64, 256, 1, true },
+};
+
+int main(int argc, char* argv[]) {
+	const char* folder = argc > 1 ? argv[1] : ".";
+	char path[1024];
+	snprintf(path, sizeof(path), "%s/SdBench.img", folder);
+	printf("Free cluster summary %s, %u cache slots\n", USE_FREE_CLUSTER_SUMMARY ? "enabled" : "disabled", FAT_CACHE_SLOTS);
+
+	for (size_t i = 0; i < sizeof(scenarios) / sizeof(scenarios[0]); i++) {
+		runScenario(path, scenarios[i]);
+	}
+	remove(path);
+	return 0;
+}
@@ -52,6 +52,13 @@ extern "C" {
 
 #define _CMDMESSENGER_VERSION 3_6 // software version of this library
 
+#if defined(__AVR__)
+#include <avr/pgmspace.h>
+#define readCallback(p) ((messengerCallbackFunction)pgm_read_word(p))
+#else
+#define readCallback(p) (*(p))
+#endif
+
 // **** Initialization **** 
 
 /**
@@ -78,8 +85,8 @@ void CmdMessenger::init(Stream &ccomms, const char fld_separator, const char cmd
 	reset();
 
 	default_callback = NULL;
-	for (int i = 0; i < MAXCALLBACKS; i++)
-		callbackList[i] = NULL;
+	callbackTable = NULL;
+	callbackCount = 0;
 
 	pauseProcessing = false;
 }
@@ -90,9 +97,9 @@ void CmdMessenger::init(Stream &ccomms, const char fld_separator, const char cmd
 void CmdMessenger::reset()
 {
 	bufferIndex = 0;
+	argCount = 0;
+	argIndex = 0;
 	current = NULL;
-	last = NULL;
-	dumped = true;
 }
 
 /**
@@ -112,12 +119,13 @@ void CmdMessenger::attach(messengerCallbackFunction newFunction)
 }
 
 /**
- * Attaches a function to a command ID
+ * Attaches a table of functions, indexed by command ID. NULL entries are not attached.
+ * The table must be in PROGMEM, so it uses no RAM however many commands there are.
  */
-void CmdMessenger::attach(byte msgId, messengerCallbackFunction newFunction)
+void CmdMessenger::attach(const messengerCallbackFunction *table, uint8_t count)
 {
-	if (msgId >= 0 && msgId < MAXCALLBACKS)
-		callbackList[msgId] = newFunction;
+	callbackTable = table;
+	callbackCount = count;
 }
 
 // **** Command processing ****
@@ -127,50 +135,58 @@ void CmdMessenger::attach(byte msgId, messengerCallbackFunction newFunction)
  */
 void CmdMessenger::feedinSerialData()
 {
+	// Bytes are tokenized as they are read, so there is no need to buffer them first.
 	while (!pauseProcessing && comms->available())
 	{
-		// The Stream class has a readBytes() function that reads many bytes at once. On Teensy 2.0 and 3.0, readBytes() is optimized. 
-		// Benchmarks about the incredible difference it makes: http://www.pjrc.com/teensy/benchmark_usb_serial_receive.html
-
-		size_t bytesAvailable = min(comms->available(), MAXSTREAMBUFFERSIZE);
-		comms->readBytes(streamBuffer, bytesAvailable);
+		int messageState = processLine(comms->read());
 
-		// Process the bytes in the stream buffer, and handles dispatches callbacks, if commands are received
-		for (size_t byteNo = 0; byteNo < bytesAvailable; byteNo++)
+		// If waiting for acknowledge command
+		if (messageState == kEndOfMessage)
 		{
-			int messageState = processLine(streamBuffer[byteNo]);
-
-			// If waiting for acknowledge command
-			if (messageState == kEndOfMessage)
-			{
-				handleMessage();
-			}
+			handleMessage();
 		}
 	}
 }
 
 /**
  * Processes bytes and determines message state
+ * Unescapes the message and splits it into arguments in a single pass,
+ * so reading an argument is just a lookup.
  */
 uint8_t CmdMessenger::processLine(char serialChar)
 {
 	messageState = kProccesingMessage;
-	//char serialChar = (char)serialByte;
 	bool escaped = isEscaped(&serialChar, escape_character, &CmdlastChar);
+	if (bufferIndex == 0) {
+		// Start of a new message. The command ID is the first argument.
+		argStart[0] = 0;
+		argCount = 1;
+		argIndex = 0;
+	}
+	if ((serialChar == escape_character) && !escaped) {
+		// Only the escaped character is stored
+		return messageState;
+	}
 	if ((serialChar == command_separator) && !escaped) {
 		commandBuffer[bufferIndex] = 0;
 		if (bufferIndex > 0) {
 			messageState = kEndOfMessage;
-			current = commandBuffer;
+			messageLength = bufferIndex;
 			CmdlastChar = '\0';
 		}
-		reset();
+		bufferIndex = 0;
+		return messageState;
+	}
+	if ((serialChar == field_separator) && !escaped) {
+		commandBuffer[bufferIndex++] = 0;
+		if (argCount < MAXARGUMENTS) {
+			argStart[argCount++] = bufferIndex;
+		}
 	}
 	else {
-		commandBuffer[bufferIndex] = serialChar;
-		bufferIndex++;
-		if (bufferIndex >= bufferLastIndex) reset();
+		commandBuffer[bufferIndex++] = serialChar;
 	}
+	if (bufferIndex >= bufferLastIndex) reset();
 	return messageState;
 }
 
@@ -180,9 +196,12 @@ uint8_t CmdMessenger::processLine(char serialChar)
 void CmdMessenger::handleMessage()
 {
 	lastCommandId = readInt16Arg();
+	messengerCallbackFunction callback = NULL;
+	if (ArgOk && lastCommandId < callbackCount)
+		callback = readCallback(&callbackTable[lastCommandId]);
 	// if command attached, we will call it
-	if (lastCommandId >= 0 && lastCommandId < MAXCALLBACKS && ArgOk && callbackList[lastCommandId] != NULL)
-		(*callbackList[lastCommandId])();
+	if (callback != NULL)
+		(*callback)();
 	else // If command not attached, call default callback (if attached)
 		if (default_callback != NULL) (*default_callback)();
 }
@@ -229,23 +248,12 @@ bool CmdMessenger::checkForAck(byte ackCommand)
  */
 bool CmdMessenger::next()
 {
-	char * temppointer = NULL;
-	// Currently, cmd messenger only supports 1 char for the field seperator
-	switch (messageState) {
-	case kProccesingMessage:
+	if (messageState == kProccesingMessage || argIndex >= argCount) {
 		return false;
-	case kEndOfMessage:
-		temppointer = commandBuffer;
-		messageState = kProcessingArguments;
-	default:
-		if (dumped)
-			current = split_r(temppointer, field_separator, &last);
-		if (current != NULL) {
-			dumped = true;
-			return true;
-		}
 	}
-	return false;
+	messageState = kProcessingArguments;
+	current = &commandBuffer[argStart[argIndex++]];
+	return true;
 }
 
 /**
@@ -316,6 +324,21 @@ void CmdMessenger::sendCmdfArg(char *fmt, ...)
 	}
 }
 
+/**
+ * Send a buffer as a single argument in binary format
+ *  Note that this will only succeed if a sendCmdStart has been issued first
+ */
+void CmdMessenger::sendCmdBinArg(const void *data, uint8_t size)
+{
+	if (startCommand) {
+		comms->print(field_separator);
+		const char *bytePointer = (const char *)data;
+		for (uint8_t i = 0; i < size; i++) {
+			printEsc(*bytePointer++);
+		}
+	}
+}
+
 #if 0
 /**
  * Send double argument in scientific format.
@@ -375,39 +398,12 @@ bool CmdMessenger::sendCmd(byte cmdId)
 
 // **** Command receiving ****
 
-/**
- * Find next argument in command
- */
-int CmdMessenger::findNext(char *str, char delim)
-{
-	int pos = 0;
-	bool escaped = false;
-	bool EOL = false;
-	ArglastChar = '\0';
-	while (true) {
-		escaped = isEscaped(str, escape_character, &ArglastChar);
-		EOL = (*str == '\0' && !escaped);
-		if (EOL) {
-			return pos;
-		}
-		if (*str == field_separator && !escaped) {
-			return pos;
-		}
-		else {
-			str++;
-			pos++;
-		}
-	}
-	return pos;
-}
-
 /**
  * Read the next argument as int
  */
 int16_t CmdMessenger::readInt16Arg()
 {
 	if (next()) {
-		dumped = true;
 		ArgOk = true;
 		return atoi(current);
 	}
@@ -421,7 +417,6 @@ int16_t CmdMessenger::readInt16Arg()
 int32_t CmdMessenger::readInt32Arg()
 {
 	if (next()) {
-		dumped = true;
 		ArgOk = true;
 		return atol(current);
 	}
@@ -443,7 +438,6 @@ bool CmdMessenger::readBoolArg()
 char CmdMessenger::readCharArg()
 {
 	if (next()) {
-		dumped = true;
 		ArgOk = true;
 		return current[0];
 	}
@@ -457,7 +451,6 @@ char CmdMessenger::readCharArg()
 float CmdMessenger::readFloatArg()
 {
 	if (next()) {
-		dumped = true;
 		ArgOk = true;
 		//return atof(current);
 		return strtod(current, NULL);
@@ -472,7 +465,6 @@ float CmdMessenger::readFloatArg()
 double CmdMessenger::readDoubleArg()
 {
 	if (next()) {
-		dumped = true;
 		ArgOk = true;
 		return strtod(current, NULL);
 	}
@@ -487,7 +479,6 @@ double CmdMessenger::readDoubleArg()
 char* CmdMessenger::readStringArg()
 {
 	if (next()) {
-		dumped = true;
 		ArgOk = true;
 		return current;
 	}
@@ -495,6 +486,26 @@ char* CmdMessenger::readStringArg()
 	return '\0';
 }
 
+/**
+ * Read the next argument in binary format into data.
+ * Returns the length of the argument, or 0 if it is missing or longer than size.
+ */
+uint8_t CmdMessenger::readBinArg(void *data, uint8_t size)
+{
+	if (next()) {
+		// Arguments are null terminated, so the end is just before the next one.
+		uint8_t end = (argIndex < argCount) ? argStart[argIndex] - 1 : messageLength;
+		uint8_t length = end - argStart[argIndex - 1];
+		if (length <= size) {
+			memcpy(data, current, length);
+			ArgOk = true;
+			return length;
+		}
+	}
+	ArgOk = false;
+	return 0;
+}
+
 /**
  * Return next argument as a new string
  * Note that this is useful if the string needs to be persisted
@@ -502,7 +513,6 @@ char* CmdMessenger::readStringArg()
 void CmdMessenger::copyStringArg(char *string, uint8_t size)
 {
 	if (next()) {
-		dumped = true;
 		ArgOk = true;
 		strlcpy(string, current, size);
 	}
@@ -519,7 +529,6 @@ uint8_t CmdMessenger::compareStringArg(char *string)
 {
 	if (next()) {
 		if (strcmp(string, current) == 0) {
-			dumped = true;
 			ArgOk = true;
 			return 1;
 		}
@@ -533,59 +542,6 @@ uint8_t CmdMessenger::compareStringArg(char *string)
 
 // **** Escaping tools ****
 
-/**
- * Unescapes a string
- * Note that this is done inline
- */
-void CmdMessenger::unescape(char *fromChar)
-{
-	// Move unescaped characters right
-	char *toChar = fromChar;
-	while (*fromChar != '\0') {
-		if (*fromChar == escape_character) {
-			fromChar++;
-		}
-		*toChar++ = *fromChar++;
-	}
-	// Pad string with \0 if string was shortened
-	for (; toChar < fromChar; toChar++) {
-		*toChar = '\0';
-	}
-}
-
-/**
- * Split string in different tokens, based on delimiter
- * Note that this is basically strtok_r, but with support for an escape character
- */
-char* CmdMessenger::split_r(char *str, const char delim, char **nextp)
-{
-	char *ret;
-	// if input null, this is not the first call, use the nextp pointer instead
-	if (str == NULL) {
-		str = *nextp;
-	}
-	// Strip leading delimiters
-	while (findNext(str, delim) == 0 && *str) {
-		str++;
-	}
-	// If this is a \0 char, return null
-	if (*str == '\0') {
-		return NULL;
-	}
-	// Set start of return pointer to this position
-	ret = str;
-	// Find next delimiter
-	str += findNext(str, delim);
-	// and exchange this for a a \0 char. This will terminate the char
-	if (*str) {
-		*str++ = '\0';
-	}
-	// Set the next pointer to this char
-	*nextp = str;
-	// return current pointer
-	return ret;
-}
-
 /**
  * Indicates if the current character is escaped
  */
@@ -40,9 +40,8 @@ extern "C"
 	typedef void(*messengerCallbackFunction) (void);
 }
 
-#define MAXCALLBACKS        10   // The maximum number of commands   (default: 50)
 #define MESSENGERBUFFERSIZE 64	   // The length of the commandbuffer  (default: 64)
-#define MAXSTREAMBUFFERSIZE 64  // The length of the streambuffer   (default: 64)
+#define MAXARGUMENTS        10   // The maximum number of arguments, including the command ID
 #define DEFAULT_TIMEOUT     5000 // Time out on unanswered messages. (default: 5s)
 
 // Message States
@@ -66,18 +65,17 @@ private:
 	uint8_t bufferIndex;              // Index where to write data in buffer
 	uint8_t bufferLength;             // Is set to MESSENGERBUFFERSIZE
 	uint8_t bufferLastIndex;          // The last index of the buffer
-	char ArglastChar;                 // Bookkeeping of argument escape char 
 	char CmdlastChar;                 // Bookkeeping of command escape char 
 	bool pauseProcessing;             // pauses processing of new commands, during sending
 	bool print_newlines;              // Indicates if \r\n should be added after send command
-	char commandBuffer[MESSENGERBUFFERSIZE]; // Buffer that holds the data
-	char streamBuffer[MAXSTREAMBUFFERSIZE]; // Buffer that holds the data
+	char commandBuffer[MESSENGERBUFFERSIZE]; // Unescaped message. Each argument is null terminated
+	uint8_t argStart[MAXARGUMENTS];   // Offset of each argument in commandBuffer
+	uint8_t argCount;                 // Number of arguments in the message
+	uint8_t argIndex;                 // Next argument to be read
+	uint8_t messageLength;            // Length of the last message in commandBuffer
 	uint8_t messageState;             // Current state of message processing
-	bool dumped;                      // Indicates if last argument has been externally read 
 	bool ArgOk;						// Indicated if last fetched argument could be read
-	char *current;                    // Pointer to current buffer position
-	char *last;                       // Pointer to previous buffer position
-	char prevChar;                    // Previous char (needed for unescaping)
+	char *current;                    // Pointer to current argument
 	Stream *comms;                    // Serial data stream
 
 	char command_separator;           // Character indicating end of command (default: ';')
@@ -85,7 +83,8 @@ private:
 	char escape_character;		    // Character indicating escaping of special chars
 
 	messengerCallbackFunction default_callback;            // default callback function  
-	messengerCallbackFunction callbackList[MAXCALLBACKS];  // list of attached callback functions 
+	const messengerCallbackFunction *callbackTable;        // PROGMEM table of callbacks, indexed by command ID
+	uint8_t callbackCount;                                 // Number of entries in callbackTable
 
 
 	// **** Initialize ****
@@ -118,8 +117,6 @@ private:
 
 	// **** Command receiving ****
 
-	int findNext(char *str, char delim);
-
 	/**
 	 * Read a variable of any type in binary format
 	 */
@@ -127,7 +124,6 @@ private:
 	T readBin(char *str)
 	{
 		T value;
-		unescape(str);
 		byte *bytePointer = (byte *)(const void *)&value;
 		for (unsigned int i = 0; i < sizeof(value); i++)
 		{
@@ -152,7 +148,6 @@ private:
 
 	// **** Escaping tools ****
 
-	char *split_r(char *str, const char delim, char **nextp);
 	bool isEscaped(char *currChar, const char escapeChar, char *lastChar);
 
 	void printEsc(char *str);
@@ -170,7 +165,7 @@ public:
 
 	void printLfCr(bool addNewLine = true);
 	void attach(messengerCallbackFunction newFunction);
-	void attach(byte msgId, messengerCallbackFunction newFunction);
+	void attach(const messengerCallbackFunction *table, uint8_t count);
 
 	// **** Command processing ****
 
@@ -266,6 +261,8 @@ public:
 		}
 	}
 
+	void sendCmdBinArg(const void *data, uint8_t size);
+
 	// **** Command receiving ****
 	bool readBoolArg();
 	int16_t readInt16Arg();
@@ -276,6 +273,7 @@ public:
 	double readDoubleArg();
 #endif
 	char *readStringArg();
+	uint8_t readBinArg(void *data, uint8_t size);
 	void copyStringArg(char *string, uint8_t size);
 	uint8_t compareStringArg(char *string);
 
@@ -285,7 +283,6 @@ public:
 	template < class T > T readBinArg()
 	{
 		if (next()) {
-			dumped = true;
 			return readBin < T >(current);
 		}
 		else {
@@ -295,7 +292,6 @@ public:
 
 	// **** Escaping tools ****
 
-	void unescape(char *fromChar);
 #if 0
 	void printSci(double f, unsigned int digits);
 #endif
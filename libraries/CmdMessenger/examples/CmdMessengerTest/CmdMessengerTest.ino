@@ -23,9 +23,8 @@ CmdMessenger cmdMessenger = CmdMessenger(Serial, field_separator, command_separa
 
 // ------------------ C M D  L I S T I N G ( T X / R X ) ---------------------
 
-// We can define up to a default of 50 cmds total, including both directions (send + receive)
-// and including also the first 4 default command codes for the generic error handling.
-// If you run out of message slots, then just increase the value of MAXCALLBACKS in CmdMessenger.h
+// Commands are indexed from 0. Each one that is received needs an entry
+// in the handler table in attachCommandCallbacks.
 
  // This is the list of recognized commands. These can be commands that can either be sent or received. 
  // In order to receive, attach a callback function to these events
@@ -96,22 +95,32 @@ enum
 
 void attachCommandCallbacks()
 {
-  // Attach callback methods
-  //cmdMessenger.attach(OnUnknownCommand);
-  cmdMessenger.attach(kAreYouReady, OnArduinoReady);
-  cmdMessenger.attach(kAskUsIfReady, OnAskUsIfReady);
+  // Indexed by command. NULL for commands that are only sent.
+  // Kept in PROGMEM, so it only costs flash.
+  static const messengerCallbackFunction commandHandlers[] PROGMEM = {
+    NULL,                // kCommError
+    NULL,                // kComment
+    NULL,                // kAcknowledge
+    OnArduinoReady,      // kAreYouReady
+    NULL,                // kError
+    OnAskUsIfReady,      // kAskUsIfReady
+    NULL,                // kYouAreReady
+    OnValuePing,         // kValuePing
+    NULL,                // kValuePong
+    OnMultiValuePing,    // kMultiValuePing
+    NULL,                // kMultiValuePong
+    OnRequestReset,      // kRequestReset
+    NULL,                // kRequestResetAcknowledge
+    OnRequestSeries,     // kRequestSeries
+    NULL,                // kReceiveSeries
+    NULL,                // kDoneReceiveSeries
+    OnPrepareSendSeries, // kPrepareSendSeries
+    OnSendSeries,        // kSendSeries
+  };
 
-  // Clear & Binary text data test
-  cmdMessenger.attach(kValuePing, OnValuePing);
-  cmdMessenger.attach(kMultiValuePing, OnMultiValuePing);
-  
-  // Benchmarks
+  // Attach callback methods
   cmdMessenger.attach(OnUnknownCommand);
-  cmdMessenger.attach(kRequestReset,      OnRequestReset);
-  cmdMessenger.attach(kRequestSeries,     OnRequestSeries);
-
-  cmdMessenger.attach(kPrepareSendSeries, OnPrepareSendSeries);
-  cmdMessenger.attach(kSendSeries,        OnSendSeries);
+  cmdMessenger.attach(commandHandlers, sizeof(commandHandlers) / sizeof(commandHandlers[0]));
 }
 
 // ------------------  C A L L B A C K S -----------------------
@@ -245,7 +254,6 @@ void OnValuePing()
       case kEscString:   
       {   
         char * value = cmdMessenger.readStringArg();
-        cmdMessenger.unescape(value);
         cmdMessenger.sendCmdStart(kValuePong);
         cmdMessenger.sendCmdEscArg(value);
         cmdMessenger.sendCmdEnd();
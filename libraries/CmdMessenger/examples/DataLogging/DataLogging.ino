@@ -33,9 +33,17 @@ enum
 
 void attachCommandCallbacks()
 {
+  // Indexed by command. NULL for commands that are only sent.
+  // Kept in PROGMEM, so it only costs flash.
+  static const messengerCallbackFunction commandHandlers[] PROGMEM = {
+    NULL,           // kAcknowledge
+    NULL,           // kError
+    OnStartLogging, // kStartLogging
+  };
+
   // Attach callback methods
   cmdMessenger.attach(OnUnknownCommand);
-  cmdMessenger.attach(kStartLogging, OnStartLogging);
+  cmdMessenger.attach(commandHandlers, sizeof(commandHandlers) / sizeof(commandHandlers[0]));
 }
 
 // ------------------  C A L L B A C K S -----------------------
@@ -15,9 +15,8 @@ const int kBlinkLed             = 13;  // Pin of internal Led
 // Attach a new CmdMessenger object to the default Serial port
 CmdMessenger cmdMessenger = CmdMessenger(Serial);
 
-// We can define up to a default of 50 cmds total, including both directions (send + receive)
-// and including also the first 4 default command codes for the generic error handling.
-// If you run out of message slots, then just increase the value of MAXCALLBACKS in CmdMessenger.h
+// Commands are indexed from 0. Each one that is received needs an entry
+// in the handler table in attachCommandCallbacks.
 
  // This is the list of recognized commands. These can be commands that can either be sent or received. 
  // In order to receive, attach a callback function to these events
@@ -38,7 +37,13 @@ enum
 // Callbacks define on which received commands we take action 
 void attachCommandCallbacks()
 {
-  cmdMessenger.attach(kSetLed, OnSetLed);
+  // Indexed by command. NULL for commands that are only sent.
+  // Kept in PROGMEM, so it only costs flash.
+  static const messengerCallbackFunction commandHandlers[] PROGMEM = {
+    OnSetLed, // kSetLed
+  };
+
+  cmdMessenger.attach(commandHandlers, sizeof(commandHandlers) / sizeof(commandHandlers[0]));
 }
 
 // Callback function that sets led on or off
@@ -25,9 +25,15 @@ enum
 // Callbacks define on which received commands we take action
 void attachCommandCallbacks()
 {
+  // Indexed by command. NULL for commands that are only sent.
+  // Kept in PROGMEM, so it only costs flash.
+  static const messengerCallbackFunction commandHandlers[] PROGMEM = {
+    OnSetLed, // kSetLed
+  };
+
   // Attach callback methods
   cmdMessenger.attach(OnUnknownCommand);
-  cmdMessenger.attach(kSetLed, OnSetLed);
+  cmdMessenger.attach(commandHandlers, sizeof(commandHandlers) / sizeof(commandHandlers[0]));
 }
 
 // Called when a received command has no attached function
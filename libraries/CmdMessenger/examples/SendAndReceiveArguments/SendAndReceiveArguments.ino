@@ -34,9 +34,17 @@ enum
 
 void attachCommandCallbacks()
 {
+  // Indexed by command. NULL for commands that are only sent.
+  // Kept in PROGMEM, so it only costs flash.
+  static const messengerCallbackFunction commandHandlers[] PROGMEM = {
+    NULL,            // kAcknowledge
+    NULL,            // kError
+    OnFloatAddition, // kFloatAddition
+  };
+
   // Attach callback methods
   cmdMessenger.attach(OnUnknownCommand);
-  cmdMessenger.attach(kFloatAddition, OnFloatAddition);
+  cmdMessenger.attach(commandHandlers, sizeof(commandHandlers) / sizeof(commandHandlers[0]));
 }
 
 // ------------------  C A L L B A C K S -----------------------
@@ -28,10 +28,17 @@ enum
 // Callbacks define on which received commands we take action
 void attachCommandCallbacks()
 {
+  // Indexed by command. NULL for commands that are only sent.
+  // Kept in PROGMEM, so it only costs flash.
+  static const messengerCallbackFunction commandHandlers[] PROGMEM = {
+    OnRequestPlainTextFloatSeries, // kRequestPlainTextFloatSeries
+    NULL,                          // kReceivePlainTextFloatSeries
+    OnRequestBinaryFloatSeries,    // kRequestBinaryFloatSeries
+  };
+
   // Attach callback methods
   cmdMessenger.attach(OnUnknownCommand);
-  cmdMessenger.attach(kRequestPlainTextFloatSeries, OnRequestPlainTextFloatSeries);
-  cmdMessenger.attach(kRequestBinaryFloatSeries,    OnRequestBinaryFloatSeries);
+  cmdMessenger.attach(commandHandlers, sizeof(commandHandlers) / sizeof(commandHandlers[0]));
 }
 
 // ------------------  C A L L B A C K S -----------------------
@@ -24,10 +24,16 @@ enum
 
 void attachCommandCallbacks()
 {
+  // Indexed by command. NULL for commands that are only sent.
+  // Kept in PROGMEM, so it only costs flash.
+  static const messengerCallbackFunction commandHandlers[] PROGMEM = {
+    onIdentifyRequest, // kIdentify
+    onTurnLedOn,       // kTurnLedOn
+  };
+
   // Attach callback methods
   messenger.attach(onUnknownCommand);
-  messenger.attach(kIdentify  , onIdentifyRequest);
-  messenger.attach(kTurnLedOn , onTurnLedOn);
+  messenger.attach(commandHandlers, sizeof(commandHandlers) / sizeof(commandHandlers[0]));
 }
 
 // ------------------  C A L L B A C K S -----------------------
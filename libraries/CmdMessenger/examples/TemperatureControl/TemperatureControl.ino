@@ -98,13 +98,22 @@ enum
 // We must define a callback function in our Arduino program for each entry in the list below.
 void attachCommandCallbacks()
 {
+  // Indexed by command. NULL for commands that are only sent.
+  // Kept in PROGMEM, so it only costs flash.
+  static const messengerCallbackFunction commandHandlers[] PROGMEM = {
+    OnWatchdogRequest,    // kWatchdog
+    NULL,                 // kAcknowledge
+    NULL,                 // kError
+    OnStartLogging,       // kStartLogging
+    OnStopLogging,        // kStopLogging
+    NULL,                 // kPlotDataPoint
+    OnSetGoalTemperature, // kSetGoalTemperature
+    OnSetStartTime,       // KSetStartTime
+  };
+
   // Attach callback methods
   cmdMessenger.attach(OnUnknownCommand);
-  cmdMessenger.attach(kWatchdog, OnWatchdogRequest);
-  cmdMessenger.attach(kStartLogging, OnStartLogging);
-  cmdMessenger.attach(kStopLogging, OnStopLogging);
-  cmdMessenger.attach(kSetGoalTemperature, OnSetGoalTemperature);
-  cmdMessenger.attach(KSetStartTime, OnSetStartTime);
+  cmdMessenger.attach(commandHandlers, sizeof(commandHandlers) / sizeof(commandHandlers[0]));
 }
 
 // ------------------  C A L L B A C K S -----------------------
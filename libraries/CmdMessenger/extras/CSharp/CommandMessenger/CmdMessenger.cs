@@ -60,6 +60,7 @@ public class CmdMessenger : IDisposable
         private CommunicationManager _communicationManager;                 // The communication manager
         private MessengerCallbackFunction _defaultCallback;                 // The default callback
         private Dictionary<int, MessengerCallbackFunction> _callbackList;   // List of callbacks
+        private HashSet<int> _receiveThreadCallbacks;                       // Callbacks that are not invoked on ControlToInvokeOn
         private SendCommandQueue _sendCommandQueue;                         // The queue of commands to be sent
         private ReceiveCommandQueue _receiveCommandQueue;                   // The queue of commands to be processed
 
@@ -175,6 +176,7 @@ public CmdMessenger(ITransport transport, BoardType boardType, char fieldSeparat
 
             Escaping.EscapeChars(fieldSeparator, commandSeparator, escapeCharacter);
             _callbackList = new Dictionary<int, MessengerCallbackFunction>();
+            _receiveThreadCallbacks = new HashSet<int>();
 
             _sendCommandQueue.Start();
             _receiveCommandQueue.Start();
@@ -224,6 +226,18 @@ public void Attach(MessengerCallbackFunction newFunction)
         public void Attach(int messageId, MessengerCallbackFunction newFunction)
         {
             _callbackList[messageId] = newFunction;
+            _receiveThreadCallbacks.Remove(messageId);
+        }
+
+        /// <summary> Attaches a callback for certain Message ID that is called on the receive thread,
+        ///           in the order the commands arrive, even if ControlToInvokeOn is set.
+        ///           For high rate commands that would otherwise flood the UI thread. </summary>
+        /// <param name="messageId">   Command ID. </param>
+        /// <param name="newFunction"> The callback function. </param>
+        public void AttachOnReceiveThread(int messageId, MessengerCallbackFunction newFunction)
+        {
+            _callbackList[messageId] = newFunction;
+            _receiveThreadCallbacks.Add(messageId);
         }
 
         /// <summary> Gets or sets the time stamp of the last command line received. </summary>
@@ -247,6 +261,11 @@ private void HandleMessage(ReceivedCommand receivedCommand)
                 if (_callbackList.ContainsKey(receivedCommand.CmdId))
                 {
                     callback = _callbackList[receivedCommand.CmdId];
+                    if (_receiveThreadCallbacks.Contains(receivedCommand.CmdId))
+                    {
+                        callback(receivedCommand);
+                        return;
+                    }
                 }
                 else
                 {
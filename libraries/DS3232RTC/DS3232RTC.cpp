@@ -437,6 +437,23 @@ void DS3232RTC::clearAlarmFlag(uint8_t alarm) {
   write1(0x0F, value);  // sends 0Fh - Ctrl/Status register
 }
 
+/**
+ * Aging offset, in steps of about 0.1ppm. Positive values slow the clock.
+ */
+int8_t DS3232RTC::readAgingOffset() {
+  return (int8_t)read1(0x10);  // sends 10h - Aging Offset register
+}
+
+/**
+ * Takes effect at the next temperature conversion, so a conversion is started.
+ */
+void DS3232RTC::writeAgingOffset(int8_t offset) {
+  write1(0x10, (uint8_t)offset);  // sends 10h - Aging Offset register
+  if (!isTCXOBusy()) {
+    write1(0x0E, read1(0x0E) | DS3232_CONV);  // sends 0Eh - Control register
+  }
+}
+
 /**
  *
  */
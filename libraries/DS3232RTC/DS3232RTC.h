@@ -101,6 +101,9 @@ class DS3232RTC
     static bool isAlarmFlag(uint8_t alarm);
     static uint8_t isAlarmFlag();
     static void clearAlarmFlag(uint8_t alarm);
+    // Aging Offset
+    static int8_t readAgingOffset();
+    static void writeAgingOffset(int8_t offset);
     // Temperature
     static void readTemperature(tpElements_t &tmp);
   private:
@@ -58,8 +58,8 @@ void OLED::begin() {
   SPI.setClockDivider(5); // 16.8MHz on Due
 #endif
 
-  pinMode(pin_ncs, OUTPUT);
-  digitalWrite(pin_ncs, HIGH);
+  SpiBus.attach(spiDevice, pin_ncs, true);
+  SpiBus.capture(spiDevice);
   pinMode(pin_dc, OUTPUT);
   digitalWrite(pin_dc, HIGH);
   if(pin_reset >= 0) {
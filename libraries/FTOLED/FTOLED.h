@@ -37,6 +37,7 @@
 
 #include "pins_arduino.h"
 #include <SPI.h>
+#include <SpiBus.h>
 #include "Print.h"
 #include "progmem_compat.h"
 
@@ -220,8 +221,11 @@ public:
 
   uint8_t *font;
 
-  inline void assertCS() { digitalWrite(pin_ncs, LOW); }
-  inline void releaseCS() { digitalWrite(pin_ncs, HIGH); }
+  // The display is write only, so it keeps chip select between primitives
+  // until the SD card needs the bus.
+  SpiBusClass::Device spiDevice;
+  inline void assertCS() { SpiBus.select(spiDevice); }
+  inline void releaseCS() { SpiBus.deselect(spiDevice); }
 
   // Note: GPIO0 is panel power on OLED128, hence better to use setDisplayOn()
   void setGPIO0(OLED_GPIO_Mode gpio0);
@@ -175,6 +175,48 @@ const uint8_t SPI_SCK_INIT_DIVISOR = 128;
 #define USE_SEPARATE_FAT_CACHE 0
 #endif  // __arm__
 //------------------------------------------------------------------------------
+/**
+ * Set FAT_CACHE_SLOTS to the number of 512 byte block cache slots.
+ * Each slot costs 520 bytes of RAM.  More slots keep FAT and directory
+ * blocks cached while file data is written, saving SD reads and writes.
+ * One slot on small AVR boards, where there isn't the RAM for more.
+ */
+#ifndef FAT_CACHE_SLOTS
+#if USE_SEPARATE_FAT_CACHE
+#define FAT_CACHE_SLOTS 2
+#else  // USE_SEPARATE_FAT_CACHE
+#define FAT_CACHE_SLOTS 1
+#endif  // USE_SEPARATE_FAT_CACHE
+#endif  // FAT_CACHE_SLOTS
+//------------------------------------------------------------------------------
+/**
+ * Set USE_SPI_BUS nonzero to share the hardware SPI bus through the SpiBus
+ * library.  The card's SPI settings are then only reloaded when another
+ * device, such as a display, has used the bus since the last card access.
+ * Only for the AVR hardware SPI, SD_SPI_CONFIGURATION zero.
+ */
+#ifndef USE_SPI_BUS
+#if defined(__AVR__) && SD_SPI_CONFIGURATION == 0
+#define USE_SPI_BUS 1
+#else  // defined(__AVR__) && SD_SPI_CONFIGURATION == 0
+#define USE_SPI_BUS 0
+#endif  // defined(__AVR__) && SD_SPI_CONFIGURATION == 0
+#endif  // USE_SPI_BUS
+//------------------------------------------------------------------------------
+/**
+ * Set USE_FREE_CLUSTER_SUMMARY nonzero to keep the free cluster count
+ * and a FREE_CLUSTER_SUMMARY_SIZE byte bitmap of FAT blocks that have
+ * free clusters.  Allocation then skips full parts of the FAT, which
+ * otherwise takes seconds on a large, nearly full card.  Costs about
+ * 43 bytes of RAM, so it is off unless selected.
+ */
+#ifndef USE_FREE_CLUSTER_SUMMARY
+#define USE_FREE_CLUSTER_SUMMARY 0
+#endif  // USE_FREE_CLUSTER_SUMMARY
+#ifndef FREE_CLUSTER_SUMMARY_SIZE
+#define FREE_CLUSTER_SUMMARY_SIZE 32
+#endif  // FREE_CLUSTER_SUMMARY_SIZE
+//------------------------------------------------------------------------------
 /**
  * Set USE_MULTI_BLOCK_IO nonzero to use multi-block SD read/write.
  *
@@ -124,13 +124,20 @@ bool SdSpiCard::begin(m_spi_t* spi, uint8_t chipSelectPin, uint8_t sckDivisor) {
   uint16_t t0 = (uint16_t)millis();
   uint32_t arg;
 
+#if USE_SPI_BUS
+  SpiBus.attach(m_busDevice, m_chipSelectPin, false);
+#else  // USE_SPI_BUS
   pinMode(m_chipSelectPin, OUTPUT);
   digitalWrite(m_chipSelectPin, HIGH);
+#endif  // USE_SPI_BUS
   spiBegin();
 
   // set SCK rate for initialization commands
   m_sckDivisor = SPI_SCK_INIT_DIVISOR;
   spiInit(m_sckDivisor);
+#if USE_SPI_BUS
+  SpiBus.capture(m_busDevice);
+#endif  // USE_SPI_BUS
 
   // must supply min of 74 clock cycles with CS high.
   for (uint8_t i = 0; i < 10; i++) {
@@ -194,6 +201,11 @@ bool SdSpiCard::begin(m_spi_t* spi, uint8_t chipSelectPin, uint8_t sckDivisor) {
   }
   chipSelectHigh();
   m_sckDivisor = sckDivisor;
+#if USE_SPI_BUS
+  // Full speed from now on.
+  spiInit(m_sckDivisor);
+  SpiBus.capture(m_busDevice);
+#endif  // USE_SPI_BUS
   return true;
 
 fail:
@@ -276,7 +288,11 @@ void SdSpiCard::spiYield() {
 }
 //------------------------------------------------------------------------------
 void SdSpiCard::chipSelectHigh() {
+#if USE_SPI_BUS
+  SpiBus.deselect(m_busDevice);
+#else  // USE_SPI_BUS
   digitalWrite(m_chipSelectPin, HIGH);
+#endif  // USE_SPI_BUS
   // insure MISO goes high impedance
   spiSend(0XFF);
 #if ENABLE_SPI_TRANSACTION && defined(SPI_HAS_TRANSACTION)
@@ -292,8 +308,13 @@ void SdSpiCard::chipSelectLow() {
     SPI.beginTransaction(SPISettings());
   }
 #endif  // ENABLE_SPI_TRANSACTION && defined(SPI_HAS_TRANSACTION)
+#if USE_SPI_BUS
+  // Settings are only reloaded if another device has used the bus.
+  SpiBus.select(m_busDevice);
+#else  // USE_SPI_BUS
   spiInit(m_sckDivisor);
   digitalWrite(m_chipSelectPin, LOW);
+#endif  // USE_SPI_BUS
 }
 //------------------------------------------------------------------------------
 bool SdSpiCard::erase(uint32_t firstBlock, uint32_t lastBlock) {
@@ -27,6 +27,9 @@
 #include <SdFatConfig.h>
 #include <SdInfo.h>
 #include <SdSpi.h>
+#if USE_SPI_BUS
+#include <SpiBus.h>
+#endif  // USE_SPI_BUS
 //==============================================================================
 /**
  * \class SdSpiCard
@@ -269,6 +272,9 @@ class SdSpiCard {
     return m_spi->useSpiTransactions();
   }
   m_spi_t* m_spi;
+#if USE_SPI_BUS
+  SpiBusClass::Device m_busDevice;
+#endif  // USE_SPI_BUS
   uint8_t m_chipSelectPin;
   uint8_t m_errorCode;
   uint8_t m_sckDivisor;
@@ -76,7 +76,8 @@ fail:
 // return pointer to cached entry or null for failure
 dir_t* FatFile::cacheDirEntry(uint8_t action) {
   cache_t* pc;
-  pc = m_vol->cacheFetchData(m_dirBlock, action);
+  pc = m_vol->cacheFetchData(m_dirBlock,
+                             action | FatCache::CACHE_STATUS_META);
   if (!pc) {
     DBG_FAIL_MACRO;
     goto fail;
@@ -773,7 +774,7 @@ int FatFile::read(void* buf, size_t nbyte) {
       }
       block = m_vol->clusterStartBlock(m_curCluster) + blockOfCluster;
     }
-    if (offset != 0 || toRead < 512 || block == m_vol->cacheBlockNumber()) {
+    if (offset != 0 || toRead < 512 || m_vol->cacheHasAny(block, 1)) {
       // amount to be read from current block
       n = 512 - offset;
       if (n > toRead) {
@@ -797,8 +798,7 @@ int FatFile::read(void* buf, size_t nbyte) {
         }
       }
       n = 512*nb;
-      if (m_vol->cacheBlockNumber() <= block
-          && block < (m_vol->cacheBlockNumber() + nb)) {
+      if (m_vol->cacheHasAny(block, nb)) {
         // flush cache if a block is in the cache
         if (!m_vol->cacheSync()) {
           DBG_FAIL_MACRO;
@@ -1468,11 +1468,8 @@ int FatFile::write(const void* buf, size_t nbyte) {
         nBlock = maxBlocks;
       }
       n = 512*nBlock;
-      if (m_vol->cacheBlockNumber() <= block
-          && block < (m_vol->cacheBlockNumber() + nBlock)) {
-        // invalidate cache if block is in cache
-        m_vol->cacheInvalidate();
-      }
+      // invalidate cache if block is in cache
+      m_vol->cacheInvalidate(block, nBlock);
       if (!m_vol->writeBlocks(block, src, nBlock)) {
         DBG_FAIL_MACRO;
         goto fail;
@@ -1481,9 +1478,7 @@ int FatFile::write(const void* buf, size_t nbyte) {
     } else {
       // use single block write command
       n = 512;
-      if (m_vol->cacheBlockNumber() == block) {
-        m_vol->cacheInvalidate();
-      }
+      m_vol->cacheInvalidate(block, 1);
       if (!m_vol->writeBlock(block, src)) {
         DBG_FAIL_MACRO;
         goto fail;
@@ -79,6 +79,41 @@
 #endif  // __arm__
 #endif  // USE_SEPARATE_FAT_CACHE
 //------------------------------------------------------------------------------
+/**
+ * Number of 512 byte block cache slots shared by FAT, directory and file
+ * data blocks.  FAT and directory blocks are kept in preference to file
+ * data, so two slots behave like USE_SEPARATE_FAT_CACHE and three also
+ * keep a file's directory block while appending to it.
+ *
+ * Use cacheHits() and cacheMisses() to measure the effect.
+ */
+#ifndef FAT_CACHE_SLOTS
+#if USE_SEPARATE_FAT_CACHE
+#define FAT_CACHE_SLOTS 2
+#else  // USE_SEPARATE_FAT_CACHE
+#define FAT_CACHE_SLOTS 1
+#endif  // USE_SEPARATE_FAT_CACHE
+#endif  // FAT_CACHE_SLOTS
+//------------------------------------------------------------------------------
+/**
+ * Set USE_FREE_CLUSTER_SUMMARY non-zero to speed up cluster allocation and
+ * freeClusterCount() on large, nearly full volumes.
+ *
+ * The free cluster count is kept in RAM and written to the FAT32 FSINFO
+ * sector.  The FSINFO count is never read back, as other systems often
+ * leave it stale, so the first freeClusterCount() after a mount scans the FAT.
+ * A summary bitmap of FREE_CLUSTER_SUMMARY_SIZE bytes has a bit for each
+ * group of FAT blocks, cleared when the group is known to have no free
+ * clusters, so allocation skips full parts of the FAT without reading them.
+ * On large volumes each bit covers several FAT blocks.
+ */
+#ifndef USE_FREE_CLUSTER_SUMMARY
+#define USE_FREE_CLUSTER_SUMMARY 0
+#endif  // USE_FREE_CLUSTER_SUMMARY
+#ifndef FREE_CLUSTER_SUMMARY_SIZE
+#define FREE_CLUSTER_SUMMARY_SIZE 32
+#endif  // FREE_CLUSTER_SUMMARY_SIZE
+//------------------------------------------------------------------------------
 /**
  * Set USE_MULTI_BLOCK_IO non-zero to use multi-block SD read/write.
  *
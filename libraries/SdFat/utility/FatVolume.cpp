@@ -64,15 +64,136 @@ fail:
   return false;
 }
 //------------------------------------------------------------------------------
+cache_t* FatVolume::cacheFetch(uint32_t blockNumber, uint8_t options) {
+  uint8_t slot = FAT_CACHE_SLOTS;
+  cache_t* pc;
+  for (uint8_t i = 0; i < FAT_CACHE_SLOTS; i++) {
+    if (m_cache[i].lbn() == blockNumber) {
+      slot = i;
+      break;
+    }
+  }
+  if (slot < FAT_CACHE_SLOTS) {
+    m_cacheHits++;
+  } else {
+    m_cacheMisses++;
+    slot = cacheVictim(options);
+  }
+  pc = m_cache[slot].read(blockNumber, options);
+  if (!pc) {
+    DBG_FAIL_MACRO;
+    goto fail;
+  }
+  m_cache[slot].touch(++m_cacheTick);
+  if (!(options & FatCache::CACHE_STATUS_MIRROR_FAT)) {
+    m_cacheData = slot;
+  }
+  return pc;
+
+fail:
+  return 0;
+}
+//------------------------------------------------------------------------------
+uint8_t FatVolume::cacheVictim(uint8_t options) {
+  uint8_t victim = FAT_CACHE_SLOTS;
+  uint16_t victimAge = 0;
+  bool victimMeta = true;
+  for (uint8_t i = 0; i < FAT_CACHE_SLOTS; i++) {
+    FatCache* slot = &m_cache[i];
+    if (slot->isEmpty()) {
+      return i;
+    }
+    if (FAT_CACHE_SLOTS > 1 && i == m_cacheData &&
+        (options & FatCache::CACHE_STATUS_MIRROR_FAT)) {
+      continue;
+    }
+    uint16_t age = m_cacheTick - slot->lastUse();
+    bool meta = slot->isMeta();
+    // File data first, then the least recently used.
+    if (victim == FAT_CACHE_SLOTS || (victimMeta && !meta) ||
+        (victimMeta == meta && age > victimAge)) {
+      victim = i;
+      victimAge = age;
+      victimMeta = meta;
+    }
+  }
+  return victim;
+}
+//------------------------------------------------------------------------------
+bool FatVolume::cacheSync() {
+  if (!fsInfoSync()) {
+    DBG_FAIL_MACRO;
+    goto fail;
+  }
+  for (uint8_t i = 0; i < FAT_CACHE_SLOTS; i++) {
+    if (!m_cache[i].sync()) {
+      DBG_FAIL_MACRO;
+      goto fail;
+    }
+  }
+  return true;
+
+fail:
+  return false;
+}
+//------------------------------------------------------------------------------
+void FatVolume::cacheInvalidate(uint32_t blockNumber, uint8_t count) {
+  for (uint8_t i = 0; i < FAT_CACHE_SLOTS; i++) {
+    if (m_cache[i].lbn() - blockNumber < count) {
+      m_cache[i].invalidate();
+    }
+  }
+}
+//------------------------------------------------------------------------------
+bool FatVolume::cacheHasAny(uint32_t blockNumber, uint8_t count) {
+  for (uint8_t i = 0; i < FAT_CACHE_SLOTS; i++) {
+    if (m_cache[i].lbn() - blockNumber < count) {
+      return true;
+    }
+  }
+  return false;
+}
+//------------------------------------------------------------------------------
 bool FatVolume::allocateCluster(uint32_t current, uint32_t* next) {
   uint32_t find = current ? current : m_allocSearchStart;
-  uint32_t start = find;
+  // Clusters left to check.
+  uint32_t todo = clusterCount();
+#if USE_FREE_CLUSTER_SUMMARY
+  // Set when the current summary group has been checked from its start.
+  bool wholeGroup = false;
+#endif  // USE_FREE_CLUSTER_SUMMARY
   while (1) {
+    if (todo == 0) {
+      // Can't find space checked all clusters.
+#if USE_FREE_CLUSTER_SUMMARY
+      m_freeClusterCount = 0;
+      m_fsInfoDirty = true;
+#endif  // USE_FREE_CLUSTER_SUMMARY
+      DBG_FAIL_MACRO;
+      goto fail;
+    }
+    todo--;
     find++;
     // If at end of FAT go to beginning of FAT.
     if (find > m_lastCluster) {
       find = 2;
     }
+#if USE_FREE_CLUSTER_SUMMARY
+    uint32_t groupEnd = summaryGroupEnd(find);
+    if (!summaryMayBeFree(find)) {
+      // Skip a group with no free clusters without reading its FAT blocks.
+      uint32_t skip = groupEnd - find;
+      if (skip > todo) {
+        skip = todo;
+      }
+      find += skip;
+      todo -= skip;
+      continue;
+    }
+    if (summaryGroupStart(find)) {
+      wholeGroup = true;
+    }
+#endif  // USE_FREE_CLUSTER_SUMMARY
     uint32_t f;
     int8_t fg = fatGet(find, &f);
     if (fg < 0) {
@@ -82,11 +203,11 @@ bool FatVolume::allocateCluster(uint32_t current, uint32_t* next) {
     if (fg && f == 0) {
       break;
     }
-    if (find == start) {
-      // Can't find space checked all clusters.
-      DBG_FAIL_MACRO;
-      goto fail;
+#if USE_FREE_CLUSTER_SUMMARY
+    if (find == groupEnd && wholeGroup) {
+      summarySet(find, false);
     }
+#endif  // USE_FREE_CLUSTER_SUMMARY
   }
   // mark end of chain
   if (!fatPutEOC(find)) {
@@ -103,6 +224,9 @@ bool FatVolume::allocateCluster(uint32_t current, uint32_t* next) {
     // Remember place for search start.
     m_allocSearchStart = find;
   }
+#if USE_FREE_CLUSTER_SUMMARY
+  freeCountChange(-1);
+#endif  // USE_FREE_CLUSTER_SUMMARY
   *next = find;
   return true;
 
@@ -171,6 +295,9 @@ bool FatVolume::allocContiguous(uint32_t count, uint32_t* firstCluster) {
     }
     endCluster--;
   }
+#if USE_FREE_CLUSTER_SUMMARY
+  freeCountChange(-count);
+#endif  // USE_FREE_CLUSTER_SUMMARY
   // return first cluster number to caller
   *firstCluster = bgnCluster;
   return true;
@@ -340,6 +467,10 @@ bool FatVolume::freeChain(uint32_t cluster) {
     if (cluster < m_allocSearchStart) {
       m_allocSearchStart = cluster;
     }
+#if USE_FREE_CLUSTER_SUMMARY
+    summarySet(cluster, true);
+    freeCountChange(1);
+#endif  // USE_FREE_CLUSTER_SUMMARY
     cluster = next;
   } while (fg);
 
@@ -349,11 +480,42 @@ fail:
   return false;
 }
 //------------------------------------------------------------------------------
+#if USE_FREE_CLUSTER_SUMMARY
+// Write the free count and next free hint to FSINFO if they have changed.
+bool FatVolume::fsInfoSync() {
+  cache_t* pc;
+  if (m_fsInfoDirty && m_fsInfoBlock) {
+    pc = cacheFetchData(m_fsInfoBlock, FatCache::CACHE_FOR_WRITE);
+    if (!pc) {
+      DBG_FAIL_MACRO;
+      goto fail;
+    }
+    pc->fsinfo.freeCount = m_freeClusterCount;
+    pc->fsinfo.nextFree = m_allocSearchStart + 1;
+  }
+  m_fsInfoDirty = false;
+  return true;
+
+fail:
+  return false;
+}
+#endif  // USE_FREE_CLUSTER_SUMMARY
+//------------------------------------------------------------------------------
 int32_t FatVolume::freeClusterCount() {
   uint32_t free = 0;
   uint32_t lba;
   uint32_t todo = m_lastCluster + 1;
   uint16_t n;
+#if USE_FREE_CLUSTER_SUMMARY
+  // Cluster after the last one counted.
+  uint32_t cluster = 0;
+  // Free count at the start of the current summary group.
+  uint32_t groupStartFree = 0;
+
+  if (m_freeClusterCount >= 0) {
+    return m_freeClusterCount;
+  }
+#endif  // USE_FREE_CLUSTER_SUMMARY
 
   if (FAT12_SUPPORT && m_fatType == 12) {
     for (unsigned i = 2; i < todo; i++) {
@@ -393,12 +555,24 @@ int32_t FatVolume::freeClusterCount() {
         }
       }
       todo -= n;
+#if USE_FREE_CLUSTER_SUMMARY
+      // Groups are whole FAT blocks so the summary is rebuilt as well.
+      cluster += n;
+      if (todo == 0 || summaryGroupStart(cluster)) {
+        summarySet(cluster - 1, free != groupStartFree);
+        groupStartFree = free;
+      }
+#endif  // USE_FREE_CLUSTER_SUMMARY
     }
   } else {
     // invalid FAT type
     DBG_FAIL_MACRO;
     goto fail;
   }
+#if USE_FREE_CLUSTER_SUMMARY
+  m_freeClusterCount = free;
+  m_fsInfoDirty = true;
+#endif  // USE_FREE_CLUSTER_SUMMARY
   return free;
 
 fail:
@@ -414,11 +588,18 @@ bool FatVolume::init(uint8_t part) {
   uint8_t tmp;
   m_fatType = 0;
   m_allocSearchStart = 1;
-
-  m_cache.init(this);
-#if USE_SEPARATE_FAT_CACHE
-  m_fatCache.init(this);
-#endif  // USE_SEPARATE_FAT_CACHE
+#if USE_FREE_CLUSTER_SUMMARY
+  m_freeClusterCount = -1;
+  m_fsInfoBlock = 0;
+  m_fsInfoDirty = false;
+#endif  // USE_FREE_CLUSTER_SUMMARY
+
+  for (uint8_t i = 0; i < FAT_CACHE_SLOTS; i++) {
+    m_cache[i].init(this);
+    m_cache[i].touch(0);
+  }
+  m_cacheData = 0;
+  m_cacheTick = 0;
 
   // if part == 0 assume super floppy with FAT boot sector in block zero
   // if part > 0 assume mbr volume with partition table
@@ -501,6 +682,33 @@ bool FatVolume::init(uint8_t part) {
     m_rootDirStart = fbs->fat32RootCluster;
     m_fatType = 32;
   }
+#if USE_FREE_CLUSTER_SUMMARY
+  // Every group may have free clusters until the FAT has been read.
+  memset(m_freeSummary, 0XFF, sizeof(m_freeSummary));
+  // At least one FAT block per bit.
+  m_summaryShift = m_fatType == 32 ? 7 : 8;
+  while ((m_lastCluster >> m_summaryShift) >= 8*sizeof(m_freeSummary)) {
+    m_summaryShift++;
+  }
+  if (m_fatType == 32 && fbs->fat32FSInfo) {
+    uint32_t lbn = volumeStartBlock + fbs->fat32FSInfo;
+    pc = cacheFetchData(lbn, FatCache::CACHE_FOR_READ);
+    if (!pc) {
+      DBG_FAIL_MACRO;
+      goto fail;
+    }
+    if (pc->fsinfo.leadSignature == FSINFO_LEAD_SIG &&
+        pc->fsinfo.structSignature == FSINFO_STRUCT_SIG) {
+      m_fsInfoBlock = lbn;
+      // The free count and next free are only hints and are often stale.
+      // A wrong next free just starts the search in the wrong place, but a
+      // wrong free count would never be corrected, so it is counted again.
+      if (pc->fsinfo.nextFree >= 2 && pc->fsinfo.nextFree <= m_lastCluster) {
+        m_allocSearchStart = pc->fsinfo.nextFree - 1;
+      }
+    }
+  }
+#endif  // USE_FREE_CLUSTER_SUMMARY
   return true;
 
 fail:
@@ -565,6 +773,15 @@ bool FatVolume::wipe(print_t* pr) {
     DBG_FAIL_MACRO;
     goto fail;
   }
+#if USE_FREE_CLUSTER_SUMMARY
+  // Let the next init count the free clusters.
+  m_freeClusterCount = -1;
+  m_fsInfoDirty = true;
+  if (!fsInfoSync()) {
+    DBG_FAIL_MACRO;
+    goto fail;
+  }
+#endif  // USE_FREE_CLUSTER_SUMMARY
   if (m_fatType == 32) {
     // Reserve root cluster.
     if (!fatPutEOC(m_rootDirStart) || !cacheSync()) {
@@ -97,9 +97,11 @@ class FatCache {
   static const uint8_t CACHE_STATUS_DIRTY = 1;
   /** Cashed block is FAT entry and must be mirrored in second FAT. */
   static const uint8_t CACHE_STATUS_MIRROR_FAT = 2;
+  /** Cached block is a directory block. Kept in preference to file data. */
+  static const uint8_t CACHE_STATUS_META = 8;
   /** Cache block status bits */
   static const uint8_t CACHE_STATUS_MASK
-    = CACHE_STATUS_DIRTY | CACHE_STATUS_MIRROR_FAT;
+    = CACHE_STATUS_DIRTY | CACHE_STATUS_MIRROR_FAT | CACHE_STATUS_META;
   /** Sync existing block but do not read new block. */
   static const uint8_t CACHE_OPTION_NO_READ = 4;
   /** Cache block for read. */
@@ -129,6 +131,24 @@ class FatCache {
     m_status = 0;
     m_lbn = 0XFFFFFFFF;
   }
+  /** \return true if the cached block is a FAT or directory block. */
+  bool isMeta() const {
+    return m_status & (CACHE_STATUS_MIRROR_FAT | CACHE_STATUS_META);
+  }
+  /** \return true if no block is cached. */
+  bool isEmpty() const {
+    return m_lbn == 0XFFFFFFFF;
+  }
+  /** \return Volume fetch count when the block was last used. */
+  uint16_t lastUse() const {
+    return m_lastUse;
+  }
+  /** Record a use of the cached block.
+   * \param[in] tick Volume fetch count.
+   */
+  void touch(uint16_t tick) {
+    m_lastUse = tick;
+  }
   /** \return Logical block number for cached block. */
   uint32_t lbn() {
     return m_lbn;
@@ -145,6 +165,7 @@ class FatCache {
 
  private:
   uint8_t m_status;
+  uint16_t m_lastUse;
   FatVolume* m_vol;
   uint32_t m_lbn;
   cache_t m_block;
@@ -158,7 +179,7 @@ class FatVolume {
  public:
   /** Create an instance of FatVolume
    */
-  FatVolume() : m_fatType(0) {}
+  FatVolume() : m_fatType(0), m_cacheHits(0), m_cacheMisses(0) {}
 
   /** \return The volume's cluster size in blocks. */
   uint8_t blocksPerCluster() const {
@@ -175,8 +196,33 @@ class FatVolume {
     if (!cacheSync()) {
       return 0;
     }
-    m_cache.invalidate();
-    return m_cache.block();
+    for (uint8_t i = 0; i < FAT_CACHE_SLOTS; i++) {
+      m_cache[i].invalidate();
+    }
+    m_cacheData = 0;
+    return m_cache[0].block();
+  }
+  /** Write any dirty cached blocks to the device.
+   *
+   * Lets a caller split a file sync into steps, so that it can wait for
+   * the device to finish programming each step without blocking.
+   *
+   * \return true for success or false for failure.
+   */
+  bool cacheFlush() {
+    return cacheSync();
+  }
+  /** \return Number of block fetches found in the cache. */
+  uint32_t cacheHits() const {
+    return m_cacheHits;
+  }
+  /** \return Number of block fetches that had to read or reserve a block. */
+  uint32_t cacheMisses() const {
+    return m_cacheMisses;
+  }
+  /** Reset the cache hit and miss counts. */
+  void cacheResetStats() {
+    m_cacheHits = m_cacheMisses = 0;
   }
   /** \return The total number of clusters in the volume. */
   uint32_t clusterCount() const {
@@ -203,6 +249,9 @@ class FatVolume {
     return m_fatType;
   }
   /** Volume free space in clusters.
+   *
+   * With USE_FREE_CLUSTER_SUMMARY the FAT is only scanned if the count
+   * is not already known from the FSINFO sector or an earlier scan.
    *
    * \return Count of free clusters for success or -1 if an error occurs.
    */
@@ -254,6 +303,28 @@ class FatVolume {
   int8_t dbgFat(uint32_t n, uint32_t* v) {
     return fatGet(n, v);
   }
+//------------------------------------------------------------------------------
+ protected:
+  /** Choose the cache slot to hold a block that is not cached.
+   *
+   * Override to change the replacement policy.  The default is least
+   * recently used, but FAT and directory blocks are only replaced if
+   * every slot holds one.  A FAT block never replaces the last file data
+   * block fetched, as callers may still be using it.
+   *
+   * \param[in] options Options of the fetch, CACHE_STATUS_MIRROR_FAT for
+   * a FAT block and CACHE_STATUS_META for a directory block.
+   * \return The slot index, less than FAT_CACHE_SLOTS.
+   */
+  virtual uint8_t cacheVictim(uint8_t options);
+  /** \return The cache slots. */
+  FatCache* cacheSlot(uint8_t i) {
+    return &m_cache[i];
+  }
+  /** \return Slot of the last file data block fetched. */
+  uint8_t cacheDataSlot() const {
+    return m_cacheData;
+  }
 //------------------------------------------------------------------------------
  private:
   // Allow FatFile and FatCache access to FatVolume private functions.
@@ -271,44 +342,44 @@ class FatVolume {
   uint32_t m_fatStartBlock;        // Start block for first FAT.
   uint32_t m_lastCluster;          // Last cluster number in FAT.
   uint32_t m_rootDirStart;         // Start block for FAT16, cluster for FAT32.
+#if USE_FREE_CLUSTER_SUMMARY
+  int32_t  m_freeClusterCount;     // Free clusters, -1 if unknown.
+  uint32_t m_fsInfoBlock;          // FAT32 FSINFO block, zero if none.
+  bool     m_fsInfoDirty;          // Free count not yet written to FSINFO.
+  uint8_t  m_summaryShift;         // Cluster number to summary bit shift.
+  // Bit is clear if a group of clusters is known to have no free clusters.
+  uint8_t  m_freeSummary[FREE_CLUSTER_SUMMARY_SIZE];
+#endif  // USE_FREE_CLUSTER_SUMMARY
 //------------------------------------------------------------------------------
 // block caches
-  FatCache m_cache;
-#if USE_SEPARATE_FAT_CACHE
-  FatCache m_fatCache;
-  cache_t* cacheFetchFat(uint32_t blockNumber, uint8_t options) {
-    return m_fatCache.read(blockNumber,
-                           options | FatCache::CACHE_STATUS_MIRROR_FAT);
-  }
-  bool cacheSync() {
-    return m_cache.sync() && m_fatCache.sync();
-  }
-#else  //
+  FatCache m_cache[FAT_CACHE_SLOTS];
+  uint8_t  m_cacheData;            // Slot of the last file data block fetched.
+  uint16_t m_cacheTick;            // Fetch count, for least recently used.
+  uint32_t m_cacheHits;            // Fetches found in the cache.
+  uint32_t m_cacheMisses;          // Fetches that needed a slot.
+  cache_t* cacheFetch(uint32_t blockNumber, uint8_t options);
   cache_t* cacheFetchFat(uint32_t blockNumber, uint8_t options) {
-    return cacheFetchData(blockNumber,
-                          options | FatCache::CACHE_STATUS_MIRROR_FAT);
+    return cacheFetch(blockNumber, options | FatCache::CACHE_STATUS_MIRROR_FAT);
   }
-  bool cacheSync() {
-    return m_cache.sync();
-  }
-#endif  // USE_SEPARATE_FAT_CACHE
   cache_t* cacheFetchData(uint32_t blockNumber, uint8_t options) {
-    return m_cache.read(blockNumber, options);
-  }
-  void cacheInvalidate() {
-    m_cache.invalidate();
+    return cacheFetch(blockNumber, options);
   }
+  bool cacheSync();
+  // Invalidate any cached blocks that are about to be written directly.
+  void cacheInvalidate(uint32_t blockNumber, uint8_t count);
+  // True if any of the blocks are cached.
+  bool cacheHasAny(uint32_t blockNumber, uint8_t count);
   bool cacheSyncData() {
-    return m_cache.sync();
+    return m_cache[m_cacheData].sync();
   }
   cache_t *cacheAddress() {
-    return m_cache.block();
+    return m_cache[m_cacheData].block();
   }
   uint32_t cacheBlockNumber() {
-    return m_cache.lbn();
+    return m_cache[m_cacheData].lbn();
   }
   void cacheDirty() {
-    m_cache.dirty();
+    m_cache[m_cacheData].dirty();
   }
 //------------------------------------------------------------------------------
   bool allocateCluster(uint32_t current, uint32_t* next);
@@ -323,6 +394,42 @@ class FatVolume {
     return fatPut(cluster, 0x0FFFFFFF);
   }
   bool freeChain(uint32_t cluster);
+#if USE_FREE_CLUSTER_SUMMARY
+  void freeCountChange(int32_t change) {
+    if (m_freeClusterCount >= 0) {
+      // Going below zero means the count was wrong, so make it unknown.
+      m_freeClusterCount += change;
+      if (m_freeClusterCount < 0) {
+        m_freeClusterCount = -1;
+      }
+      m_fsInfoDirty = true;
+    }
+  }
+  bool fsInfoSync();
+  uint32_t summaryGroupEnd(uint32_t cluster) const {
+    uint32_t end = cluster | ((1UL << m_summaryShift) - 1);
+    return end < m_lastCluster ? end : m_lastCluster;
+  }
+  bool summaryGroupStart(uint32_t cluster) const {
+    return cluster == 2 || (cluster & ((1UL << m_summaryShift) - 1)) == 0;
+  }
+  bool summaryMayBeFree(uint32_t cluster) const {
+    uint16_t bit = cluster >> m_summaryShift;
+    return m_freeSummary[bit >> 3] & (1 << (bit & 7));
+  }
+  void summarySet(uint32_t cluster, bool mayBeFree) {
+    uint16_t bit = cluster >> m_summaryShift;
+    if (mayBeFree) {
+      m_freeSummary[bit >> 3] |= 1 << (bit & 7);
+    } else {
+      m_freeSummary[bit >> 3] &= ~(1 << (bit & 7));
+    }
+  }
+#else  // USE_FREE_CLUSTER_SUMMARY
+  bool fsInfoSync() {
+    return true;
+  }
+#endif  // USE_FREE_CLUSTER_SUMMARY
   bool isEOC(uint32_t cluster) const {
     return cluster > m_lastCluster;
   }
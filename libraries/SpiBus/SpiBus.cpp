@@ -0,0 +1,93 @@
+//
+//
+//
+#include "SpiBus.h"
+
+SpiBusClass SpiBus;
+
+// Chip select starts high. Attaching twice (e.g. re-initialising a driver) is harmless.
+void SpiBusClass::attach(Device& device, uint8_t csPin, bool holdSelect) {
+	bool listed = false;
+	for (Device* d = devices; d; d = d->next) {
+		listed = listed || d == &device;
+	}
+	if (!listed) {
+		device.next = devices;
+		devices = &device;
+		device.selects = 0;
+		device.busyMicros = 0;
+	}
+	if (owner == &device) {
+		owner = NULL;
+	}
+	device.csPin = csPin;
+	device.holdSelect = holdSelect;
+	device.selected = false;
+	digitalWrite(csPin, HIGH);
+	pinMode(csPin, OUTPUT);
+}
+
+// Call after configuring the SPI hardware for the device.
+void SpiBusClass::capture(Device& device) {
+	takeBus(device);
+	device.spcr = SPCR;
+	device.spsr = SPSR;
+}
+
+void SpiBusClass::select(Device& device) {
+	if (owner != &device) {
+		takeBus(device);
+		SPCR = device.spcr;
+		SPSR = device.spsr;
+	}
+	device.selects++;
+	setSelect(device, true);
+}
+
+void SpiBusClass::deselect(Device& device) {
+	if (!device.holdSelect) {
+		setSelect(device, false);
+	}
+}
+
+// Releases a held chip select, e.g. before sleeping.
+void SpiBusClass::release() {
+	if (owner) {
+		setSelect(*owner, false);
+	}
+}
+
+void SpiBusClass::resetStats() {
+	unsigned long now = micros();
+	for (Device* d = devices; d; d = d->next) {
+		d->selects = 0;
+		d->busyMicros = 0;
+		d->selectMicros = now;
+	}
+	switches = 0;
+}
+
+// Another device's held select must be released before the bus is used.
+void SpiBusClass::takeBus(Device& device) {
+	if (owner != &device) {
+		if (owner) {
+			setSelect(*owner, false);
+		}
+		owner = &device;
+		switches++;
+	}
+}
+
+void SpiBusClass::setSelect(Device& device, bool selected) {
+	if (device.selected != selected) {
+		unsigned long now = micros();
+		if (selected) {
+			device.selectMicros = now;
+		}
+		else {
+			device.busyMicros += now - device.selectMicros;
+		}
+		device.selected = selected;
+		digitalWrite(device.csPin, selected ? LOW : HIGH);
+	}
+}
@@ -0,0 +1,61 @@
+// SpiBus.h
+
+#ifndef _SPIBUS_h
+#define _SPIBUS_h
+#include <Arduino.h>
+
+//
+// DESCRIPTION::
+//
+// Shares the hardware SPI bus between devices with different clock rates and modes.
+//
+// Each device configures the SPI hardware as it likes once, then captures the
+// settings. From then on the bus reloads a device's settings only when a different
+// device was the last to use it, so drivers no longer reconfigure the bus on every
+// access or leave it at each other's settings.
+//
+// A device attached with holdSelect keeps its chip select low between transactions
+// until another device needs the bus. Devices that never read, like the OLED,
+// then don't toggle chip select for every drawing primitive.
+//
+// The bus counts how often each device is selected, how long its chip select is
+// low, and how often the settings are switched between devices.
+//
+class SpiBusClass
+{
+public:
+	struct Device {
+		uint8_t csPin;
+		bool holdSelect;
+		bool selected;				// Chip select is low
+		uint8_t spcr;				// Captured SPI settings
+		uint8_t spsr;
+		uint32_t selects;
+		uint32_t busyMicros;		// Time chip select has been low
+		unsigned long selectMicros;	// When chip select went low
+		Device* next;
+	};
+
+protected:
+	Device* owner = NULL;		// Settings currently loaded
+	Device* devices = NULL;
+	uint32_t switches = 0;
+
+	void takeBus(Device& device);
+	void setSelect(Device& device, bool selected);
+
+public:
+	void attach(Device& device, uint8_t csPin, bool holdSelect);
+	void capture(Device& device);
+	void select(Device& device);
+	void deselect(Device& device);
+	void release();
+
+	uint32_t getSwitches() { return switches; }
+	Device* getDevices() { return devices; }
+	void resetStats();
+};
+
+extern SpiBusClass SpiBus;
+
+#endif
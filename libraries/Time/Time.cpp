@@ -37,15 +37,50 @@
 
 static tmElements_t tm;          // a cache of time elements
 static time_t cacheTime;   // the time the cache was updated
+static time_t cacheMonthStart;   // the start of the month in the cache
+static time_t cacheMonthEnd;     // the start of the following month
 static uint32_t syncInterval = 300;  // time sync will be attempted after this many seconds
 
+static uint8_t monthLength(uint8_t year, uint8_t month);
+
 void refreshCache(time_t t) {
   if (t != cacheTime) {
-    breakTime(t, tm); 
+    if (t >= cacheMonthStart && t < cacheMonthEnd) {
+      // Same month as the cache, so only the day and time of day need
+      // updating. Avoids breakTime walking every year since 1970.
+      uint32_t time = (uint32_t)(t - cacheMonthStart);
+      tm.Second = time % 60;
+      time /= 60; // now it is minutes
+      tm.Minute = time % 60;
+      time /= 60; // now it is hours
+      tm.Hour = time % 24;
+      time /= 24; // now it is days
+      tm.Day = time + 1;
+      tm.Wday = ((t / SECS_PER_DAY + 4) % 7) + 1;  // Sunday is day 1
+    } else {
+      breakTime(t, tm);
+      cacheMonthStart = t - elapsedSecsToday(t) - (tm.Day - 1) * SECS_PER_DAY;
+      cacheMonthEnd = cacheMonthStart + monthLength(tm.Year, tm.Month) * SECS_PER_DAY;
+    }
     cacheTime = t; 
   }
 }
 
+const tmElements_t& timeElements(time_t t) {
+  refreshCache(t);
+  return tm;
+}
+
+time_t monthStart(time_t t) {
+  refreshCache(t);
+  return cacheMonthStart;
+}
+
+time_t nextMonthStart(time_t t) {
+  refreshCache(t);
+  return cacheMonthEnd;
+}
+
 int hour() { // the hour now 
   return hour(now()); 
 }
@@ -147,6 +182,14 @@ int year(time_t t) { // the year for the given time
 #define LEAP_YEAR(Y)     ( ((1970+Y)>0) && !((1970+Y)%4) && ( ((1970+Y)%100) || !((1970+Y)%400) ) )
 
 static  const uint8_t monthDays[]={31,28,31,30,31,30,31,31,30,31,30,31}; // API starts months from 1, this array starts from 0
+
+static uint8_t monthLength(uint8_t year, uint8_t month) {
+// year is offset from 1970, month starts from 1
+  if (month == 2 && LEAP_YEAR(year)) {
+    return 29;
+  }
+  return monthDays[month - 1];
+}
  
 void breakTime(time_t timeInput, tmElements_t &tm){
 // break the given time_t into time components
@@ -269,6 +312,13 @@ time_t now() {
   return (time_t)sysTime;
 }
 
+time_t now(uint16_t& ms) {
+  time_t t = now();
+  uint32_t elapsed = millis() - prevMillis;
+  ms = elapsed < 1000 ? elapsed : 999;  // the second may have ticked since now()
+  return t;
+}
+
 void setTime(time_t t) { 
 #ifdef TIME_DRIFT_INFO
  if(sysUnsyncedTime == 0) 
@@ -284,6 +334,8 @@ void setTime(time_t t) {
 void setTime(int hr,int min,int sec,int dy, int mnth, int yr){
  // year can be given as full four digit year or two digts (2010 or 10 for 2010);  
  //it is converted to years since 1970
+ // uses its own elements so the cache stays consistent with cacheTime
+  tmElements_t tm;
   if( yr > 99)
       yr = yr - 1970;
   else
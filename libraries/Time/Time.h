@@ -116,8 +116,12 @@ int     month();           // the month now  (Jan is month 1)
 int     month(time_t t);   // the month for the given time
 int     year();            // the full four digit year: (2009, 2010 etc) 
 int     year(time_t t);    // the year for the given time
+const tmElements_t& timeElements(time_t t); // all time elements for the given time. Valid until the next call
+time_t  monthStart(time_t t);     // the time at the start of the month for the given time
+time_t  nextMonthStart(time_t t); // the time at the start of the following month
 
 time_t now();              // return the current time as seconds since Jan 1 1970 
+time_t now(uint16_t& ms);  // as above, also returns the milliseconds into the current second
 void    setTime(time_t t);
 void    setTime(int hr,int min,int sec,int day, int month, int yr);
 void    adjustTime(long adjustment);